@@ -1,36 +1,519 @@
 // sectioning can be declared as thus
 /*** includes ***/
 
+// feature test macros, which have to come before any header. they expose functions like strdup() that strict c99 otherwise hides.
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <errno.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <langinfo.h>
+#include <limits.h>
+#include <locale.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#include <wchar.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 
 /*** defines ***/
 
 // this macro bitwise-ANDs a character with the value 0011111 in binary. Thus it sets the upper 3 bits of the character to 0, the same thing that ctrl does. 
 #define CTRL_KEY(k) ((k) & 0x1f)
 
+#define TAB_STOP 8
+
+// how long the window has to keep its size before a resize is drawn, and the longest a resize waits while it keeps changing, in seconds
+#define RESIZE_SETTLE 0.05
+#define RESIZE_MAX_WAIT 0.25
+
+// a terminal that needs longer than RENDER_SLOW seconds to take an average frame is treated as slow, until it takes RENDER_FAST_SLACK
+// bytes more than it should have been able to at the rate measured, which has to be more than the buffers on the way to it can hold. a
+// terminal that hasn't been measured is taken to have caught up with everything after RENDER_IDLE seconds without anything new.
+// RENDER_EWMA is how fast the measures follow what the terminal does now. on a slow terminal, the render thread holds off the next frame
+// until the terminal should be down to about one frame to go. it counts on the terminal being a little faster than measured, by
+// RENDER_PACE, so that it is sent a little more than the measure, which then keeps up with it. RENDER_MAX_PACE is the longest it holds
+// off for at a time.
+#define RENDER_SLOW (1.0 / 60)
+#define RENDER_IDLE 0.5
+#define RENDER_FAST_SLACK (256 * 1024)
+#define RENDER_EWMA 0.25
+#define RENDER_PACE 0.75
+#define RENDER_MAX_PACE 1.0
+// how long quitting waits for the terminal to take the rest of the row being written, in seconds. a terminal that has stopped reading,
+// like one on a stalled link, has the frame dropped unfinished.
+#define RENDER_STOP_WAIT 0.5
+
+// how many bytes of keys are read from the terminal at a time, and kept until they are handled. a power of two, so positions wrap cleanly.
+// an escape sequence that hasn't come in whole is given INPUT_SEQ_WAIT milliseconds for each of the bytes still to come.
+#define INPUT_RING (64 * 1024)
+#define INPUT_SEQ_WAIT 100
+
+// how long a cursor position report is taken as the answer to the REP probe, in seconds, for a terminal that answers nothing at all
+#define TERM_PROBE_WAIT 1.0
+
+// keys that don't map to a single byte get values outside of the char range, so they can never collide with ordinary keypresses.
+enum editorKey {
+    BACKSPACE = 127,
+    ARROW_LEFT = 1000,
+    ARROW_RIGHT,
+    ARROW_UP,
+    ARROW_DOWN,
+    DEL_KEY,
+    HOME_KEY,
+    END_KEY,
+    PAGE_UP,
+    PAGE_DOWN,
+    // not a key: the terminal answering one of the editor's queries
+    TERMINAL_REPLY
+};
+
 /*** data ***/
 
+// a growable array of byte offsets, which is what the newline scanners fill in
+struct offsetVec {
+    size_t *v;
+    size_t n;
+    size_t cap;
+};
+
+// the kinds of newline index. see struct nlIndex.
+enum nlIndexKind {
+    NL_DENSE = 0,
+    NL_SPARSE,
+    NL_ELIAS_FANO
+};
+
+// one block of an elias-fano index: the offset of its first newline, the word where its upper bits start, the word where its low bits start,
+// and how many low bits each offset keeps
+struct efBlock {
+    size_t base;
+    size_t upper;
+    size_t lower;
+    int l;
+};
+
+// the newline index of one buffer. the dense form lists the offset of every '\n'. the sparse form, for read-only viewing, keeps only a
+// checkpoint every so many lines or bytes, and finds anything in between by scanning the text from the nearest one. a checkpoint is a position
+// in the text together with the number of '\n' bytes before it. the elias-fano form stores every offset like the dense one, but packed into
+// a few bits each (see the newline index section).
+struct nlIndex {
+    int kind;
+    // newlines indexed so far
+    size_t n;
+    // dense: where every '\n' is. elias-fano: the newlines of the block still being filled.
+    struct offsetVec v;
+    // elias-fano: the packed bits of all finished blocks, and where each block's bits are
+    uint64_t *bits;
+    size_t nwords;
+    size_t wordcap;
+    struct efBlock *blocks;
+    size_t nblocks;
+    size_t blockcap;
+    // sparse: checkpoint positions and the newline count before each, the text they point into, and where the last lookup left off
+    struct offsetVec cpoff;
+    struct offsetVec cprank;
+    const char *text;
+    size_t textlen;
+    size_t hintrank;
+    size_t hintpos;
+};
+
+// a piece is a span of bytes inside one of the two piece table buffers.
+enum pieceSource {
+    PT_ORIG = 0,
+    PT_ADD
+};
+
+// the pieces are kept in a treap: a binary tree ordered by document position, kept balanced by giving every node a random priority that is never
+// higher than its parent's. each node also carries the byte and newline totals of its whole subtree, so finding a byte offset or a line number,
+// and splitting or joining the tree around an edit, are all a single walk from the root.
+typedef struct ptNode {
+    int src;
+    size_t start;
+    size_t len;
+    // '\n' bytes inside this piece, and the byte and '\n' totals of the subtree rooted here
+    size_t nl;
+    size_t sumlen;
+    size_t sumnl;
+    unsigned prio;
+    struct ptNode *left;
+    struct ptNode *right;
+} ptNode;
+
+// the document is stored as a piece table: a read-only original buffer, an append-only add buffer, and a tree of pieces that, read in order,
+// spell out the document. edits never touch the buffers' existing bytes; they only split, trim and insert pieces.
+struct pieceTable {
+    const char *orig;
+    size_t origlen;
+    char *add;
+    size_t addlen;
+    size_t addcap;
+    // where every '\n' in each buffer sits. neither buffer ever changes bytes it already holds, so these only grow, and the newlines inside any
+    // piece are a contiguous run of one of them.
+    struct nlIndex orignl;
+    struct nlIndex addnl;
+    // the original buffer is indexed in the background, so only its first origfrontier bytes have their newlines counted in the tree. knownlen is
+    // the document offset that corresponds to, and line numbers are only exact before it.
+    size_t origfrontier;
+    size_t knownlen;
+    // memory budget bookkeeping. with spill set, an add buffer that would grow past it moves into an unlinked scratch file (addfd) mapped shared,
+    // so the kernel can write it out instead of holding it all in RAM. touchlo/touchhi is the range of each buffer read since the last trim,
+    // and framelo/framehi the part read while drawing the current screen. both are indexed by pieceSource. spilldir is where the scratch file
+    // is made, or NULL for /var/tmp.
+    size_t spill;
+    const char *spilldir;
+    int addfd;
+    size_t touchlo[2], touchhi[2];
+    size_t framelo[2], framehi[2];
+    ptNode *root;
+    // total length of the document in bytes
+    size_t len;
+};
+
+// the newlines of the original buffer are scanned on a thread of their own, so a big file can be drawn and edited before all of it has been read.
+// the editor holds the lock whenever it isn't waiting for input, and the thread only takes it to publish a finished chunk, then pokes the pipe.
+struct editorIndexer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int pipe[2];
+    int running;
+    // bytes of the original buffer scanned so far, published under the lock
+    size_t scanned;
+};
+
+// the screen is kept as two grids of cells: the frame being drawn, and the frame the terminal is showing. refreshing writes only the cells
+// where the two differ, so a keypress costs a few dozen bytes of output rather than the whole screen. a cell is a character and its
+// attributes, kept apart so that the characters of a row sit together in memory and can be written out straight from the grid.
+struct screen {
+    int rows, cols;
+    // the cells the grids have room for
+    int cap;
+    // a cell is a column on the terminal. it holds an ASCII character as it is. a character of more than one byte has its first byte there
+    // and all of them in the cell's SCREEN_SEQ bytes of the seq grid, which are zero for every other cell, and one two columns wide is
+    // followed by a CELL_CONT cell for its right half.
+    char *next;
+    char *nextseq;
+    unsigned char *nextattr;
+    char *shown;
+    char *shownseq;
+    unsigned char *shownattr;
+    // what shown was before the rows of the frame being written, for when the frame is cut short and some of its rows never go out
+    char *before;
+    char *beforeseq;
+    unsigned char *beforeattr;
+    // shown is only trustworthy once it has been drawn from a cleared screen
+    int valid;
+    // where the terminal's cursor is, -1 when that isn't known, and the attributes it is drawing with
+    int cy, cx;
+    unsigned char attr;
+    // whether the terminal can scroll part of the screen (DECSTBM, then line feeds or reverse indexes at its margins), which it says by
+    // answering a DA1 query. a hint for the next flush can say that rows scrolltop to scrollbot - 1 now show what used to be scrollby rows
+    // further down (or up, if negative).
+    int canscroll;
+    int scrolltop, scrollbot, scrollby;
+    // whether the terminal does synchronized output (mode 2026): it then holds off showing a frame until all of it has arrived
+    int sync;
+    // whether it can erase (ECH) and repeat (REP) characters
+    int canerase, canrepeat;
+    // whether the last frame was cut short, which leaves the cursor hidden
+    int hidden;
+};
+
+// formatted escape sequences are kept in blocks of this many bytes
+#define FRAME_ESC_BLOCK 16384
+
+// a frame on its way to the terminal, as a list of pieces of memory to be written out in order with writev(). most of them point at static
+// escape sequences or straight into the screen grid. the escape sequences that have to be formatted, like cursor moves and colors, are
+// copied into esc, a list of blocks that never move once allocated, so the pieces pointing into them stay good however many the frame
+// needs. the blocks are kept from one frame to the next, and escblock and escused say how far into them this frame has got.
+struct frame {
+    struct iovec *iov;
+    int n;
+    int cap;
+    // the bytes in all of them together
+    size_t len;
+    char **esc;
+    int nesc;
+    int escblock;
+    int escused;
+    // how far writing it has got: the pieces before first are out, and sent is the bytes that are
+    int first;
+    size_t sent;
+    // the places it can be cut short at, as lengths from its start: after the rows scroll and before the first is drawn, and after each row
+    size_t *cuts;
+    int ncuts, cutcap;
+};
+
+// how many edits the line cache remembers, and how many slots each line can go in. see struct lineCache.
+#define LINE_CACHE_LOG 64
+#define LINE_CACHE_WAYS 4
+
+// a line as last rendered for the screen: the line starting at off and ending at end, scrolled to coloff. gen is the edit generation it
+// is known to be good for, 0 for an empty slot, and used says when it was last looked up.
+struct lineCacheEntry {
+    size_t off, end;
+    size_t coloff;
+    unsigned long gen;
+    unsigned long used;
+    int len;
+};
+
+// rendered lines, so that drawing the same lines again, as when scrolling back and forth, doesn't render them again. lines are known by
+// where they start rather than by number, since line numbers that start out as estimates change when the real ones become known.
+// every edit bumps gen and notes where it happened in log. an entry from an older generation is still good if every edit since then was
+// past its end, because then neither its text nor its position moved. the slots are grouped in sets of LINE_CACHE_WAYS, and a line can go
+// in any slot of the set its start hashes to. each slot has room for one screen row of SCREEN_SEQ bytes a column, and its attributes.
+struct lineCache {
+    struct lineCacheEntry *slots;
+    char *text;
+    unsigned char *attr;
+    int nslots;
+    int cols;
+    unsigned long gen;
+    unsigned long clock;
+    size_t log[LINE_CACHE_LOG];
+    unsigned long hits, misses;
+};
+
+// the soft wrap layout: how many screen rows each line takes up when lines are wrapped at cols. a line's width doesn't depend on cols, so
+// widths are kept once measured, and a new cols only means counting rows again, without reading any text. lines are measured as they are
+// drawn, and the rest a bit at a time between keys.
+// the row counts are summed in a fenwick tree, which takes a screen row to the line it falls in, and a line to its first screen row, in
+// O(log n). tree[i] holds the rows of lines i - lowbit(i) to i - 1, but only up to built: past it the entries are worked out again in
+// order, between keys, after anything that moves lines around or changes cols. total is the rows of the lines before built.
+struct wrapLayout {
+    // the width of each line plus one, or 0 for a line not measured yet, which counts as one row until it is
+    unsigned *width;
+    size_t *tree;
+    size_t n, cap;
+    size_t built;
+    size_t total;
+    int cols;
+};
+
+// how far apart the column index marks a long line, in bytes, and how many lines it keeps marks for. see struct columnIndex.
+#define COLUMN_MARK_STEP 16384
+#define COLUMN_INDEX_LINES 4
+
+// where the highlighter is in a line: in a string, and just past a backslash in one, just past a '/' outside one, in a // comment, just
+// past a separator, and just past a digit of a number. a line starts out just past a separator.
+struct hlState {
+    char quote;
+    unsigned char escaped, slash, comment, sep, number;
+};
+
+// a place in a line where a character starts: its byte cx, the column rx it is drawn from, and the highlighting state there
+struct columnMark {
+    size_t cx, rx;
+    struct hlState hl;
+};
+
+// the marks of a line that starts at start, from about COLUMN_MARK_STEP bytes into it on, up to as far into it as it has been read. used
+// says when it was last looked up.
+struct columnLine {
+    size_t start;
+    struct columnMark *marks;
+    size_t n, cap;
+    unsigned long used;
+};
+
+// marks in the long lines read lately, so that finding the column of a byte far into a line, or the byte drawn at a column, reads from the
+// nearest mark rather than from the start of the line, and a long line that is being typed into isn't read in full for every frame. an
+// edit drops the marks past it, and all of a line's marks if the line moved.
+struct columnIndex {
+    struct columnLine lines[COLUMN_INDEX_LINES];
+    unsigned long clock;
+};
+
+// what it takes to draw one frame, copied out of the editor by the input thread for the render thread. once handed over it doesn't change,
+// so the render thread can draw from it while the input thread carries on editing the document.
+struct snapshot {
+    // the text area it was made for, and the room it has
+    int rows, cols;
+    int cap;
+    // the text rows, already rendered: row y is len[y] bytes from text + y * cols * SCREEN_SEQ, or -1 past the end of the document, with
+    // room for a whole UTF-8 character in each column. attr has their attributes, in the same places.
+    char *text;
+    unsigned char *attr;
+    int *len;
+    size_t rowoff;
+    // the cursor, on the screen
+    int cy, cx;
+    char status[80];
+    char rstatus[80];
+    char msg[80];
+    // how many of the status and message bars there is room for under the text
+    int bars;
+    // what the terminal has said it can do
+    int canscroll, sync, erase, repeat;
+    // E.resizes when it was made
+    unsigned resizes;
+};
+
+// keys read from the terminal that haven't been handled yet. a paste arrives all at once, and taking all of it that fits in one read()
+// instead of a byte at a time is the difference between a handful of system calls and one for every byte. head and tail only ever count
+// up, and are taken modulo INPUT_RING to find the byte.
+struct inputRing {
+    unsigned char b[INPUT_RING];
+    size_t head, tail;
+};
+
+// the render thread draws the newest snapshot there is, one at a time. pending is the next one for it, and a newer one simply takes its
+// place, so a frame that would already be out of date is never drawn. there are three snapshots to go round: whatever the render thread is
+// doing, one of them is neither pending nor being drawn, and the input thread fills that one without waiting.
+struct editorRenderer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct snapshot snaps[3];
+    struct snapshot *pending;
+    struct snapshot *drawing;
+    int running;
+    int stop;
+    // when the thread is to stop, how long it may still wait on the terminal: until stopby, on the editorNow() clock
+    double stopby;
+    // frames are written to fd, which doesn't block. while the terminal isn't taking any more, the thread waits on it and on wake, a pipe
+    // that is written to when there is a newer snapshot or the thread is to stop.
+    int fd;
+    int wake[2];
+    // how fast the terminal takes what is written to it, in bytes a second, or 0 when it has kept up with everything. it can only be
+    // measured while the terminal is behind. a write then waits until the terminal has got through as much of what it was sent as it
+    // takes for it to make room, which is about the same each time, so from the end of one wait to the end of the next, if the terminal
+    // had something to do all along, it took just what was written in between. the same goes from when it had nothing left to do.
+    // since a terminal that keeps up never makes the editor wait, what it takes is not much more than the measure, which is why it is
+    // let go of only when the terminal has taken a good deal more. sent is the bytes ever written, caughtup when the terminal last caught
+    // up and caughtupsent how many had been written then. queued is how many of them it may still have had to get through at the end of
+    // the last write, at lastwrite. wbytes is a moving average of the bytes in a frame.
+    double rate;
+    size_t sent;
+    double caughtup;
+    size_t caughtupsent;
+    double queued;
+    double lastwrite;
+    double wbytes;
+    // the last frame left the status and message rows as they were, to spend the bytes on the text
+    int deferred;
+    // the line at the top of the screen when it was last drawn, and the resizes it had been through
+    size_t drawnrowoff;
+    unsigned drawnresizes;
+};
+
 struct editorConfig {
+    // cx is a byte index into line cy, rx is the same position in rendered columns (tabs expanded)
+    size_t cx, cy;
+    size_t rx;
+    size_t rowoff;
+    size_t coloff;
     int screenrows;
     int screencols;
+    // the bars under the text: the status bar and then the message bar, or fewer on a terminal with no room for them
+    int screenbars;
+    // the screen and the frame being written to it belong to the render thread. frame is kept from one refresh to the next along with the
+    // room it has grown, so that once the editor has drawn a few frames, drawing allocates nothing.
+    struct screen screen;
+    struct frame frame;
+    struct editorRenderer render;
+    struct lineCache lines;
+    struct columnIndex columns;
+    // with soft wrap on, long lines are wrapped instead of scrolled sideways. the top of the screen is then row rowsub of line rowoff, and
+    // the cursor sits at wrapcy, wrapcx on the screen.
+    int wrap;
+    size_t rowsub;
+    int wrapcy, wrapcx;
+    struct wrapLayout layout;
+    // what the terminal has said it can do: scroll regions, synchronized output, and erasing and repeating characters
+    int termscroll;
+    int termsync;
+    int termerase;
+    int termrepeat;
+    // while the REP probe is out, until when its answer is waited for, on the editorNow() clock, and 0 once it has come back or the
+    // terminal has answered the query after it
+    double termprobe;
+    char *filename;
+    // whether the file is one that gets highlighted
+    int syntax;
+    char statusmsg[80];
+    time_t statusmsg_time;
+    struct pieceTable pt;
+    struct editorIndexer idx;
+    // when the document is read from a pipe, keys come from the terminal itself instead of stdin, and streamfd is where the text comes from.
+    // it is -1 once the stream ends, or when editing a regular file.
+    int ttyfd;
+    int streamfd;
+    struct inputRing in;
+    // SIGWINCH writes a byte to winchpipe, so a resize wakes the event loop like any other event. a window being dragged sends a storm of
+    // them, so the new size is only taken once they have stopped for RESIZE_SETTLE seconds, or RESIZE_MAX_WAIT after the first. winchfirst
+    // and winchlast are when the first and the latest of the pending ones came, 0 when none are pending. resizes counts the storms taken.
+    int winchpipe[2];
+    double winchfirst, winchlast;
+    unsigned resizes;
+    // the resident memory budget in bytes, or 0 for none, and the directory given for the scratch file edits spill to, or NULL
+    size_t budget;
+    char *spilldir;
+    // the directory the file is in, where edits spill without -d
+    char filedir[PATH_MAX];
+    // read-only viewing, which also swaps the file's full line index for a sparse one
+    int readonly;
+    // past knownlen line numbers can't be looked up yet. a jump out there lands on an estimated line number, and anchorline/anchoroff remember
+    // where it landed so the lines around it can be found by scanning from there. anchorbase is where knownlen was when the anchor was placed:
+    // the lines after it stay numbered from the anchor until the index reaches the anchor itself, even once the index has gone past them.
+    int anchored;
+    size_t anchorline;
+    size_t anchoroff;
+    size_t anchorbase;
     struct termios orig_termios;
 };
 
 struct editorConfig E;
 
+/*** prototypes ***/
+
+void editorIndexProgress();
+size_t editorExactLines();
+void editorTerminalReply(const char *reply);
+void editorStreamRead();
+void editorSetStatusMessage(const char *fmt, ...);
+void editorTrimMemory();
+void editorRefreshScreen();
+void editorResize();
+double editorNow();
+void editorRenderStop();
+int editorCharLen(size_t off, size_t end, size_t cx, int back);
+
 /*** terminal ***/
 
-void die(const char *s) {
+// stops drawing and clears the screen on the way out. the render thread may be in the middle of a frame, which has to be over first. the
+// clearing goes through the render thread's descriptor once there is one, which doesn't block, so a terminal that has stopped reading
+// misses it rather than keeping the editor from exiting.
+void editorClearOnExit() {
+    editorRenderStop();
+    int fd = E.render.fd > 0 ? E.render.fd : STDOUT_FILENO;
     // standard procedure to clear the screen (J) and reset cursor position (H)
-    write(STDOUT_FILENO, "\x1b[2J", 4);
-    write(STDOUT_FILENO, "\x1b[H", 3);
+    write(fd, "\x1b[2J", 4);
+    write(fd, "\x1b[H", 3);
+}
+
+void die(const char *s) {
+    editorClearOnExit();
 
     // most C library functions that fail will set the global errno variable to indicate what that error is. perror will take that error and print out a descriptive 
     // message for it. 
@@ -38,32 +521,37 @@ void die(const char *s) {
     exit(1);
 }
 
+// keys are normally read from stdin. when stdin is a pipe carrying the document instead, the terminal is opened directly.
+void editorOpenTerminal() {
+    E.ttyfd = STDIN_FILENO;
+    if (!isatty(STDIN_FILENO)) {
+        E.ttyfd = open("/dev/tty", O_RDWR);
+        if (E.ttyfd == -1) die("open /dev/tty");
+    }
+}
+
 void disableRawMode() {
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E) == -1) die("tcsetattr");
+    if (tcsetattr(E.ttyfd, TCSAFLUSH, &E.orig_termios) == -1) die("tcsetattr");
 }
 
 void enableRawMode() {
     // obtain a copy of terminal flags at call, and restore it when program exits 
-    if (tcgetattr(STDIN_FILENO, &E) == -1) die("tcgetattr");
+    if (tcgetattr(E.ttyfd, &E.orig_termios) == -1) die("tcgetattr");
     atexit(disableRawMode);
 
     struct termios raw = E.orig_termios;
 
-    // obtain terminal attributes using termios.h, and read them into a termios struct using tcgetattr
-
-    tcgetattr(STDIN_FILENO, &raw);
-
     // bitwise or BRKINT, INPCK, ISTIP: Vanity 
     // bitwise or ICRNL: turns off auto-translation of carriage returns (13, 'r') into newlines (10, '\n')
     // bitwise or IXON: turns off software flow control, allowing ctrl-S and ctrl-Q to be inputted 
 
-    raw.c_lflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
 
     // bitwise or OPOST: turns off all output processing features, most notably the "\n" to "\r\n" feature, which is turned on by default
-    raw.c_lflag &= ~(OPOST);
+    raw.c_oflag &= ~(OPOST);
 
     // sets character size to 8 bits per byte 
-    raw.c_lflag |= (CS8);
+    raw.c_cflag |= (CS8);
 
     // bitwise or ECHO: removes ECHO ability
     // bitwise or ICANON: turns off canonical mode, allowing us to read byte-by-byte instead of line-by-line
@@ -73,28 +561,220 @@ void enableRawMode() {
     raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
 
     // VMIN: sets minimum number of bytes of input before read() can return
-    // VMAX: sets the maximum amount of time to wait before read() returns
+    // VTIME: sets the maximum amount of time to wait before read() returns
+    // both are 0, so read() takes whatever is there and returns at once. all the waiting for keys is done in poll(), along with everything else.
 
     raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    raw.c_cc[VTIME] = 0;
 
     // after modifying flags, apply them to the terminal using tcsetattr
 
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) die("tcsetattr");
+    if (tcsetattr(E.ttyfd, TCSAFLUSH, &raw) == -1) die("tcsetattr");
+}
+
+// reads whatever keys the terminal has that fit in the free space of the ring, which wraps around into two pieces at most. returns how
+// many bytes it got.
+size_t inputFill() {
+    struct inputRing *in = &E.in;
+    size_t room = INPUT_RING - (in->tail - in->head), at = in->tail % INPUT_RING;
+    if (room == 0) return 0;
+    struct iovec iov[2];
+    int n = 1;
+    iov[0].iov_base = &in->b[at];
+    iov[0].iov_len = INPUT_RING - at < room ? INPUT_RING - at : room;
+    if (iov[0].iov_len < room) {
+        iov[1].iov_base = in->b;
+        iov[1].iov_len = room - iov[0].iov_len;
+        n = 2;
+    }
+    ssize_t got = readv(E.ttyfd, iov, n);
+    if (got == -1) {
+        if (errno == EAGAIN || errno == EINTR) return 0;
+        die("read");
+    }
+    in->tail += got;
+    return got;
+}
+
+// takes the next byte of input. when none has been read yet, it waits up to INPUT_SEQ_WAIT for one to come, for the rest of an escape
+// sequence or a reply from the terminal. returns 1 if there was one.
+int inputGet(char *c) {
+    struct inputRing *in = &E.in;
+    if (in->head == in->tail) {
+        struct pollfd fd = {E.ttyfd, POLLIN, 0};
+        if (poll(&fd, 1, INPUT_SEQ_WAIT) > 0) inputFill();
+        if (in->head == in->tail) return 0;
+    }
+    *c = in->b[in->head++ % INPUT_RING];
+    return 1;
+}
+
+// the poll timeout until a pending resize should be taken, in milliseconds, or -1 if there is none
+int editorResizeWait() {
+    if (E.winchfirst == 0) return -1;
+    double due = E.winchlast + RESIZE_SETTLE, now = editorNow();
+    if (due > E.winchfirst + RESIZE_MAX_WAIT) due = E.winchfirst + RESIZE_MAX_WAIT;
+    return due <= now ? 0 : (int) ((due - now) * 1000) + 1;
+}
+
+// waits until there is a keypress to read, news from the indexing thread, more text on the stream being read, or a resize, and handles all
+// but the first. the index lock is only let go of while blocked here, which is what lets the thread publish. returns 1 when a key is waiting. poll() skips
+// entries with a negative descriptor, so the stream slot can stay in the list after the stream ends. timeout is in milliseconds, as for
+// poll(), so 0 only checks what is already there and -1 waits for as long as it takes. keys read before and not handled yet count as waiting,
+// so then it doesn't wait at all.
+int editorPollEvents(int timeout) {
+    if (E.in.head != E.in.tail) timeout = 0;
+    struct pollfd fds[4] = {
+        {E.ttyfd, POLLIN, 0},
+        {E.idx.pipe[0], POLLIN, 0},
+        {E.streamfd, POLLIN, 0},
+        {E.winchpipe[0], POLLIN, 0},
+    };
+
+    pthread_mutex_unlock(&E.idx.lock);
+    int n = poll(fds, 4, timeout);
+    pthread_mutex_lock(&E.idx.lock);
+    if (n == -1 && errno != EINTR) die("poll");
+
+    if (fds[1].revents & POLLIN) {
+        char buf[64];
+        while (read(E.idx.pipe[0], buf, sizeof(buf)) > 0);
+    }
+    editorIndexProgress();
+    if (fds[2].revents & (POLLIN | POLLHUP | POLLERR)) editorStreamRead();
+    if (fds[3].revents & POLLIN) {
+        char buf[64];
+        while (read(E.winchpipe[0], buf, sizeof(buf)) > 0);
+        E.winchlast = editorNow();
+        if (E.winchfirst == 0) E.winchfirst = E.winchlast;
+    }
+    if (E.winchfirst != 0 && editorResizeWait() == 0) editorResize();
+    if (n > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+        // a terminal that has hung up is always ready, with nothing left to read
+        if (!inputFill() && E.in.head == E.in.tail && (fds[0].revents & (POLLHUP | POLLERR))) die("read");
+    }
+    return E.in.head != E.in.tail;
+}
+
+// whether there are more keys to handle before drawing. the ones already read don't need asking the kernel about, so a big paste is
+// worked through without a system call for every key in it. the other events wait for the next time around the main loop.
+int editorKeyWaiting() {
+    return E.in.head != E.in.tail || editorPollEvents(0);
+}
+
+void editorHandleWinch(int sig) {
+    (void) sig;
+    int saved = errno;
+    write(E.winchpipe[1], "", 1);
+    errno = saved;
 }
 
 // editorReadKey() belongs in the terminal section because it deals with low level terminal input, while editorProcessKeyPress deals with
 // mapping keys to editor functions at a much higher level. 
-char editorReadKey() {
-    int nread;
+int editorReadKey() {
     char c;
-    // if read() times out it returns -1 with an error no of EAGAIN instead of just returning 0 like it's supposed to. So we won't treat EAGAIN as an error. 
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-        if (nread == -1 && errno != EAGAIN) die("read"); 
+    while (E.in.head == E.in.tail && !editorPollEvents(editorResizeWait()));
+    inputGet(&c);
+
+    // arrow and navigation keys arrive as escape sequences such as "\x1b[A" or "\x1b[5~". if the bytes after the escape don't show up in time,
+    // the user just pressed escape on its own.
+    if (c == '\x1b') {
+        char seq[2];
+
+        if (inputGet(&seq[0]) != 1) return '\x1b';
+        if (inputGet(&seq[1]) != 1) return '\x1b';
+
+        if (seq[0] == '[' && seq[1] == '?') {
+            // a reply to a query looks like "\x1b[?62;22c", and runs up to its final letter
+            char reply[32];
+            int i = 0;
+            while (i < (int) sizeof(reply) - 1 && inputGet(&reply[i]) == 1) {
+                if (reply[i++] >= 0x40 && reply[i - 1] <= 0x7e) break;
+            }
+            reply[i] = '\0';
+            editorTerminalReply(reply);
+            return TERMINAL_REPLY;
+        }
+        if (seq[0] == '[') {
+            if (seq[1] >= '0' && seq[1] <= '9') {
+                // the rest runs up to the final byte too. "\x1b[5~" is a key, and "\x1b[1;3R" the cursor position report that answers the
+                // REP probe. a key with modifiers can look just like that report, so it's only taken as one while the probe is out.
+                char params[32];
+                int i = 0;
+                params[i++] = seq[1];
+                while (i < (int) sizeof(params) - 1 && inputGet(&params[i]) == 1) {
+                    if (params[i++] >= 0x40 && params[i - 1] <= 0x7e) break;
+                }
+                params[i] = '\0';
+                if (params[i - 1] == 'R' && E.termprobe != 0 && editorNow() < E.termprobe) {
+                    editorTerminalReply(params);
+                    return TERMINAL_REPLY;
+                }
+                if (i == 2 && params[1] == '~') {
+                    switch (params[0]) {
+                        case '1': return HOME_KEY;
+                        case '3': return DEL_KEY;
+                        case '4': return END_KEY;
+                        case '5': return PAGE_UP;
+                        case '6': return PAGE_DOWN;
+                        case '7': return HOME_KEY;
+                        case '8': return END_KEY;
+                    }
+                }
+            } else {
+                switch (seq[1]) {
+                    case 'A': return ARROW_UP;
+                    case 'B': return ARROW_DOWN;
+                    case 'C': return ARROW_RIGHT;
+                    case 'D': return ARROW_LEFT;
+                    case 'H': return HOME_KEY;
+                    case 'F': return END_KEY;
+                }
+            }
+        } else if (seq[0] == 'O') {
+            switch (seq[1]) {
+                case 'H': return HOME_KEY;
+                case 'F': return END_KEY;
+            }
+        }
+        return '\x1b';
     }
     return c;
 }
 
+// asks the terminal what it can do. it answers at its own pace, through the same channel as the keys, and editorReadKey() hands the answers
+// to editorTerminalReply(). a terminal that never answers is simply never assumed to do any more than the basics.
+void editorQueryTerminal() {
+    // first whether mode 2026, synchronized output, is known (DECRQM). REP isn't a DEC control, and no class promises it, so it is tried out
+    // next: a character and a repeat of it in the top left corner, and then where the cursor ended up (DSR 6). the first frame clears the
+    // screen, which wipes out the test. last the device attributes (DA1). every terminal that answers anything answers DA1, and any answer
+    // to it at all means a vt100-style terminal, which can scroll a region of the screen. terminals answer in order, so one that has said
+    // nothing about mode 2026 or the cursor by the time DA1 comes back won't, and a key that looks like a cursor position report after
+    // that is a key. so is one after TERM_PROBE_WAIT, from a terminal that doesn't answer DA1 either.
+    static const char query[] = "\x1b[?2026$p\x1b[Hx\x1b[b\x1b[6n\x1b[c";
+    write(STDOUT_FILENO, query, sizeof(query) - 1);
+    E.termprobe = editorNow() + TERM_PROBE_WAIT;
+}
+
+// reply is what followed "\x1b[?", e.g. "62;22c" or "2026;2$y", or what followed "\x1b[" for a cursor position report, e.g. "1;3R"
+void editorTerminalReply(const char *reply) {
+    size_t len = strlen(reply);
+    int mode, state, row, col;
+    if (len > 0 && reply[len - 1] == 'c') {
+        E.termscroll = 1;
+        E.termprobe = 0;
+        // the first number is the terminal's class. vt220 and later (62 and up) erase characters (ECH).
+        if (atoi(reply) >= 62) E.termerase = 1;
+    }
+    // the cursor is past the repeated character only if the repeat was drawn
+    if (len > 0 && reply[len - 1] == 'R' && sscanf(reply, "%d;%dR", &row, &col) == 2) {
+        E.termprobe = 0;
+        if (col == 3) E.termrepeat = 1;
+    }
+    // the mode's state is 1 or 2 when it is set or reset and can be changed, 3 when it's permanently on, and 0 or 4 when it isn't supported
+    if (sscanf(reply, "%d;%d$y", &mode, &state) == 2 && mode == 2026 && state >= 1 && state <= 3) E.termsync = 1;
+}
+
 int getCursorPosition(int *rows, int *cols) {
     char buf[32];
     unsigned int i = 0;
@@ -102,7 +782,7 @@ int getCursorPosition(int *rows, int *cols) {
     if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4) return -1;
 
     while (i < sizeof(buf) - 1) {
-        if (read(STDIN_FILENO, &buf[i], 1) != 1) break;
+        if (inputGet(&buf[i]) != 1) break;
         if (buf[i] == 'R') break;
         i++;
     }
@@ -112,7 +792,7 @@ int getCursorPosition(int *rows, int *cols) {
     if (buf[0] != '\x1b' || buf[1] != '[') return -1;
     if (sscanf(&buf[2], "%d;%d", rows, cols) != 2) return -1;
 
-    return -1;
+    return 0;
 }
 
 int getWindowSize(int *rows, int *cols) {
@@ -120,7 +800,7 @@ int getWindowSize(int *rows, int *cols) {
 
     if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 ||ws.ws_col == 0) {
         // the hard way
-        if (write(STDOUT_FILENO, "\x1b[99C\x1b[999B", 12) != 12) return -1;
+        if (write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12) return -1;
         return getCursorPosition(rows, cols);
     } else {
         // the easy way 
@@ -130,101 +810,4161 @@ int getWindowSize(int *rows, int *cols) {
     }
 }
 
-/*** append buffer ***/
+/*** newline scanning ***/
 
-struct abuf {
-    char *b;
-    int len;
-};
+void ovReserve(struct offsetVec *ov, size_t extra) {
+    if (ov->n + extra <= ov->cap) return;
+    size_t cap = ov->cap ? ov->cap : 1024;
+    while (cap < ov->n + extra) cap *= 2;
+    size_t *new = realloc(ov->v, cap * sizeof(size_t));
+    if (new == NULL) die("realloc");
+    ov->v = new;
+    ov->cap = cap;
+}
 
-// an append buffer consists of a pointer to our buffer in memory and a length. the ABUF_INIT constant represents an empty buffer, acting as a constructor for abuf. 
-#define ABUF_INIT {NULL, 0}
+void ovFree(struct offsetVec *ov) {
+    free(ov->v);
+    ov->v = NULL;
+    ov->n = ov->cap = 0;
+}
 
-void abAppend(struct abuf *ab, const char *s, int len) {
-    // to append a string s to an abuf, we first ask realloc to give us a block of memory that is the size of the current string plus the size of s. 
-    char *new = realloc(ab->b, ab->len + len);
+// the scanners come in pairs: one only counts the '\n' bytes in a range, the other also records base + the position of each one. the scalar
+// versions work everywhere and finish off the tails that the vector versions leave behind.
+size_t nlCountScalar(const char *s, size_t len) {
+    size_t n = 0, i;
+    for (i = 0; i < len; i++) n += (s[i] == '\n');
+    return n;
+}
 
-    if (new == NULL) return;
-    // copies the string s after the end of the current data in the buffer, then update fields for the abuf 
-    memcpy(&new[ab->len], s, len);
-    ab->b = new;
-    ab->len += len;
+void nlCollectScalar(const char *s, size_t len, size_t base, struct offsetVec *out) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+        if (s[i] == '\n') {
+            ovReserve(out, 1);
+            out->v[out->n++] = base + i;
+        }
+    }
 }
 
-// deallocates the dynamic memory used by an abuf 
-void abFree(struct abuf *ab) {
-    free(ab->b);
+#if defined(__x86_64__) && defined(__GNUC__)
+#define ED_SIMD_X86 1
+
+// sse2 is part of the x86-64 baseline, so these are safe to call on any 64 bit x86 cpu. counting compares 16 bytes at a time: a match leaves
+// 0xff (-1) in its lane, so subtracting the compare result bumps a per-lane byte counter. the byte counters are folded into 64 bit sums with
+// psadbw before any of them can overflow, which keeps the inner loop down to a load, a compare and a subtract.
+size_t nlCountSSE2(const char *s, size_t len) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    size_t i = 0;
+
+    while (i + 16 <= len) {
+        __m128i acc = zero;
+        int k;
+        for (k = 0; k < 255 && i + 16 <= len; k++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, nl));
+        }
+        total = _mm_add_epi64(total, _mm_sad_epu8(acc, zero));
+    }
+    size_t n = (size_t) _mm_cvtsi128_si64(total) + (size_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total));
+    return n + nlCountScalar(s + i, len - i);
 }
 
-/*** output ***/
+// collecting turns each compare into a bitmask with one bit per byte, then peels the set bits off one at a time.
+void nlCollectSSE2(const char *s, size_t len, size_t base, struct offsetVec *out) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i;
 
-void editorDrawRows(struct abuf *ab) {
-    int y;
-    for (y = 0; y < E.screenrows; y++) {
-        abAppend(ab, "~", 1);
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (mask == 0) continue;
+        ovReserve(out, 16);
+        while (mask) {
+            out->v[out->n++] = base + i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    nlCollectScalar(s + i, len - i, base + i, out);
+}
+
+// the avx2 versions are the same loops at 32 bytes a step. they are compiled for avx2 regardless of the build flags, and only ever called after
+// nlInit() has checked that the cpu has it.
+__attribute__((target("avx2")))
+size_t nlCountAVX2(const char *s, size_t len) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    size_t i = 0;
 
-        abAppend(ab, "\x1b[k", 3);
-        if (y < E.screenrows - 1) {
-            abAppend(ab, "\r\n", 2);
+    while (i + 32 <= len) {
+        __m256i acc = zero;
+        int k;
+        for (k = 0; k < 255 && i + 32 <= len; k++, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, nl));
         }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(acc, zero));
     }
+    size_t n = (size_t) _mm256_extract_epi64(total, 0) + (size_t) _mm256_extract_epi64(total, 1) +
+               (size_t) _mm256_extract_epi64(total, 2) + (size_t) _mm256_extract_epi64(total, 3);
+    return n + nlCountScalar(s + i, len - i);
 }
 
-void editorRefreshScreen() {
-    struct abuf ab = ABUF_INIT;
+__attribute__((target("avx2")))
+void nlCollectAVX2(const char *s, size_t len, size_t base, struct offsetVec *out) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        if (mask == 0) continue;
+        ovReserve(out, 32);
+        while (mask) {
+            out->v[out->n++] = base + i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    nlCollectScalar(s + i, len - i, base + i, out);
+}
+#endif
+
+// the scanners everything else calls. they start out scalar and nlInit() swaps in the fastest versions this cpu can run.
+size_t (*nlCount)(const char *s, size_t len) = nlCountScalar;
+void (*nlCollect)(const char *s, size_t len, size_t base, struct offsetVec *out) = nlCollectScalar;
+const char *nlScannerName = "scalar";
+
+void nlInit() {
+#ifdef ED_SIMD_X86
+    nlCount = nlCountSSE2;
+    nlCollect = nlCollectSSE2;
+    nlScannerName = "sse2";
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        nlCount = nlCountAVX2;
+        nlCollect = nlCollectAVX2;
+        nlScannerName = "avx2";
+    }
+#endif
+}
 
-    abAppend(&ab, "\x1b[?25l", 6);
+/*** newline index ***/
 
-    /* write and STDOUT_FILENO comes from unistd.h. 4 is the number of bytes written out to the terminal, and \x1b is the escape character, 27 in decimal. 
-    the other thee bytes, [2J, is part of an escape sequence. Escape sequences instruct the terminal to do various text formatting tasks, and always start with an
-    escape character followed by a [ character. the J command (Erase in Display) clears the screen, while the argument 2 says to clear the entire screen. 1 would 
-    clear the screen up to where the cursor is, and 0 would clear the screen from the cursor up to the end of the screen. 0 is the default argument for J.
-    Mostly be using VT100 escape sequences. */
-    // write(STDOUT_FILENO, , 4); pre buffer <-, post buffer: 
-    // abAppend(&ab, "\x1b[2J", 4); replaces with abAppend(ab, "\x1b[k", 3) in editorDrawRows (entire screen -> one line)
-    
-    // H (cursor position) actually takes two arguments: [cow;col]. They start at 1, not 0. 
-    // write(STDOUT_FILENO, "\x1b[H", 3); pre buffer <-, post buffer: 
-    abAppend(&ab, "\x1b[H", 3);
+// in the sparse form there is a checkpoint at least every NL_CP_LINES lines and every NL_CP_BYTES bytes. the byte limit keeps lookups bounded
+// in files with very long lines, and the two together bound any lookup to scanning one checkpoint interval.
+#define NL_CP_LINES 1024
+#define NL_CP_BYTES (256 << 10)
 
-    editorDrawRows(&ab);
+// the elias-fano form works in blocks of this many newlines. each block picks its own low-bit width, so a file whose line lengths change
+// halfway through still packs tightly, and a lookup only ever decodes one block.
+#define NL_EF_BLOCK 512
 
-    abAppend(&ab, "\x1b[H", 3);
-    abAppend(&ab, "\x1b[?25h", 6);
+// returns the position of the k-th '\n' (counting from 0) in s, or len if there aren't that many. whole blocks are skipped with the vector
+// counter, and only the block holding the answer is searched byte by byte.
+size_t nlFindNth(const char *s, size_t len, size_t k) {
+    size_t i = 0;
+    while (i + 4096 <= len) {
+        size_t c = nlCount(s + i, 4096);
+        if (c > k) break;
+        k -= c;
+        i += 4096;
+    }
 
-    // after drawing, we reposition the cursor back up at the top-left corner. 
-    write(STDOUT_FILENO, ab.b, ab.len);
-    abFree(&ab);
+    const char *p = s + i, *end = s + len;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        if (k-- == 0) return p - s;
+        p++;
+    }
+    return len;
 }
 
-/*** input ***/
+/* elias-fano packing. a block of NL_EF_BLOCK increasing offsets x[0..B) is stored relative to its first one, base. with range the distance from
+ * the first offset to the last, each offset keeps its low l bits verbatim, l being about log2(range / B), and the rest of it, the high part,
+ * goes into a bitvector in unary: offset j sets bit (x[j] - base) >> l) + j. the high parts never decrease, so that bitvector has B ones and
+ * at most range >> l <= B zeros, and the whole block costs about l + 2 bits per newline. for lines averaging 64 bytes that is 8 bits
+ * instead of the 64 a size_t takes.
+ *
+ * getting offset j back means finding the j-th set bit, minus j, shifted up, or'd with the low bits. the upper bitvector of a block is at most
+ * 2B bits, so finding the set bit is a popcount over at most 16 words. */
 
-void editorProcessKeypress() {
-    char c = editorReadKey();
-    switch (c) {
-        case CTRL_KEY('q'):
-            // standard procedure to clear the screen (J) and reset cursor position (H)
-            write(STDOUT_FILENO, "\x1b[2J", 4);
-            write(STDOUT_FILENO, "\x1b[H", 3);
-        
-            exit(0);
-            break;
+void efReserve(struct nlIndex *ix, size_t extra) {
+    if (ix->nwords + extra <= ix->wordcap) return;
+    size_t cap = ix->wordcap ? ix->wordcap * 2 : 1024;
+    while (cap < ix->nwords + extra) cap *= 2;
+    uint64_t *bits = realloc(ix->bits, cap * sizeof(uint64_t));
+    if (bits == NULL) die("realloc");
+    ix->bits = bits;
+    ix->wordcap = cap;
+}
+
+struct efBlock *efNewBlock(struct nlIndex *ix) {
+    if (ix->nblocks == ix->blockcap) {
+        ix->blockcap = ix->blockcap ? ix->blockcap * 2 : 64;
+        ix->blocks = realloc(ix->blocks, ix->blockcap * sizeof(struct efBlock));
+        if (ix->blocks == NULL) die("realloc");
     }
+    return &ix->blocks[ix->nblocks++];
 }
-/*** init ***/
 
-void initEditor() {
-    // job is to initiaize the rows and cols attributes in the E struct. This is the easy way. 
-    if (getWindowSize(&E.screenrows, &E.screencols) == -1) die("getWindowSize");
+// reads or writes an l-bit field at bit position p, which may straddle two words. writes assume the field is still zero.
+uint64_t efGetBits(const uint64_t *w, size_t p, int l) {
+    if (l == 0) return 0;
+    size_t i = p / 64;
+    int o = p % 64;
+    uint64_t v = w[i] >> o;
+    if (o + l > 64) v |= w[i + 1] << (64 - o);
+    return l == 64 ? v : v & ((UINT64_C(1) << l) - 1);
 }
 
-int main() {
-    enableRawMode();
-    initEditor();
+void efPutBits(uint64_t *w, size_t p, int l, uint64_t v) {
+    if (l == 0) return;
+    size_t i = p / 64;
+    int o = p % 64;
+    w[i] |= v << o;
+    if (o + l > 64) w[i + 1] |= v >> (64 - o);
+}
 
-    while (1) {
-        editorRefreshScreen();
-        editorProcessKeypress();
+// packs NL_EF_BLOCK offsets into a new block at the end of ix
+void efSealBlock(struct nlIndex *ix, const size_t *x) {
+    size_t range = x[NL_EF_BLOCK - 1] - x[0];
+    int l = 0;
+    while ((range >> l) > NL_EF_BLOCK) l++;
+
+    size_t upperwords = (NL_EF_BLOCK + (range >> l) + 64) / 64;
+    size_t lowerwords = ((size_t) NL_EF_BLOCK * l + 63) / 64;
+    efReserve(ix, upperwords + lowerwords);
+    uint64_t *w = ix->bits + ix->nwords;
+    memset(w, 0, (upperwords + lowerwords) * sizeof(uint64_t));
+
+    size_t j;
+    for (j = 0; j < NL_EF_BLOCK; j++) {
+        size_t d = x[j] - x[0];
+        size_t bit = (d >> l) + j;
+        w[bit / 64] |= UINT64_C(1) << (bit % 64);
+        efPutBits(w + upperwords, j * l, l, l == 64 ? d : d & ((UINT64_C(1) << l) - 1));
+    }
+
+    struct efBlock *b = efNewBlock(ix);
+    b->base = x[0];
+    b->upper = ix->nwords;
+    b->lower = ix->nwords + upperwords;
+    b->l = l;
+    ix->nwords += upperwords + lowerwords;
+}
+
+// the j-th offset of a finished block
+size_t efBlockGet(struct nlIndex *ix, size_t blk, size_t j) {
+    const struct efBlock *b = &ix->blocks[blk];
+    const uint64_t *w = ix->bits + b->upper;
+    size_t k = j;
+    int c;
+    while ((size_t) (c = __builtin_popcountll(*w)) <= k) {
+        k -= c;
+        w++;
+    }
+    uint64_t word = *w;
+    while (k--) word &= word - 1;
+    size_t bit = (w - (ix->bits + b->upper)) * 64 + __builtin_ctzll(word);
+    return b->base + (((bit - j) << b->l) | efGetBits(ix->bits + b->lower, j * b->l, b->l));
+}
+
+// how many of a finished block's offsets are below pos
+size_t efBlockRank(struct nlIndex *ix, size_t blk, size_t pos) {
+    size_t lo = 0, hi = NL_EF_BLOCK;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (efBlockGet(ix, blk, mid) < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// how many offsets in v are below pos
+size_t ovRank(const struct offsetVec *ov, size_t pos) {
+    size_t lo = 0, hi = ov->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ov->v[mid] < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// the memory an index holds, for the benchmarks and for anyone wondering where it went
+size_t nlIndexBytes(struct nlIndex *ix) {
+    return (ix->v.cap + ix->cpoff.cap + ix->cprank.cap) * sizeof(size_t) + ix->wordcap * sizeof(uint64_t) +
+           ix->blockcap * sizeof(struct efBlock);
+}
+
+// text is the buffer being indexed. the sparse form scans it to answer lookups, so it has to stay put, which only the original buffer does.
+void nlIndexInit(struct nlIndex *ix, int kind, const char *text, size_t textlen) {
+    ovFree(&ix->v);
+    ovFree(&ix->cpoff);
+    ovFree(&ix->cprank);
+    free(ix->bits);
+    free(ix->blocks);
+    ix->bits = NULL;
+    ix->blocks = NULL;
+    ix->nwords = ix->wordcap = ix->nblocks = ix->blockcap = 0;
+    ix->kind = kind;
+    ix->text = text;
+    ix->textlen = textlen;
+    ix->n = 0;
+    ix->hintrank = ix->hintpos = 0;
+    if (kind == NL_SPARSE) {
+        // a checkpoint at the very start means every position has one at or before it
+        ovReserve(&ix->cpoff, 1);
+        ovReserve(&ix->cprank, 1);
+        ix->cpoff.v[ix->cpoff.n++] = 0;
+        ix->cprank.v[ix->cprank.n++] = 0;
+    }
+}
+
+void nlIndexCheckpoint(struct nlIndex *ix, size_t off, size_t rank) {
+    ovReserve(&ix->cpoff, 1);
+    ovReserve(&ix->cprank, 1);
+    ix->cpoff.v[ix->cpoff.n++] = off;
+    ix->cprank.v[ix->cprank.n++] = rank;
+}
+
+// adds the next cnt newline positions, which must all come after the ones already indexed, as found by scanning the text up to position upto
+void nlIndexAppend(struct nlIndex *ix, const size_t *pos, size_t cnt, size_t upto) {
+    size_t i;
+
+    if (ix->kind == NL_DENSE) {
+        ovReserve(&ix->v, cnt);
+        memcpy(&ix->v.v[ix->v.n], pos, cnt * sizeof(size_t));
+        ix->v.n += cnt;
+        ix->n += cnt;
+        return;
+    }
+
+    if (ix->kind == NL_ELIAS_FANO) {
+        ovReserve(&ix->v, NL_EF_BLOCK);
+        for (i = 0; i < cnt; i++) {
+            ix->v.v[ix->v.n++] = pos[i];
+            if (ix->v.n == NL_EF_BLOCK) {
+                efSealBlock(ix, ix->v.v);
+                ix->v.n = 0;
+            }
+        }
+        ix->n += cnt;
+        return;
+    }
+
+    for (i = 0; i <= cnt; i++) {
+        // a checkpoint can sit anywhere, so long stretches without enough newlines get byte checkpoints in the middle of lines. every one of
+        // them comes before the next newline, so n + i newlines precede it.
+        size_t stop = i < cnt ? pos[i] : upto;
+        while (stop - ix->cpoff.v[ix->cpoff.n - 1] >= NL_CP_BYTES) {
+            nlIndexCheckpoint(ix, ix->cpoff.v[ix->cpoff.n - 1] + NL_CP_BYTES, ix->n + i);
+        }
+        if (i < cnt && ix->n + i + 1 - ix->cprank.v[ix->cprank.n - 1] >= NL_CP_LINES) {
+            nlIndexCheckpoint(ix, pos[i] + 1, ix->n + i + 1);
+        }
+    }
+    ix->n += cnt;
+}
+
+// packing the elias-fano blocks is most of the cost of appending to that form, and it can be done ahead of time, on another thread, once it
+// is known how many newlines will come before the new ones. nlIndexPack() packs the whole blocks among cnt newlines that will be appended at
+// rank into packed, which only needs its kind set, and nlIndexAppendPacked() then appends them with little more than a copy. for the other
+// forms there is nothing to pack, and the second just appends.
+void nlIndexPack(struct nlIndex *packed, size_t rank, const size_t *pos, size_t cnt) {
+    packed->n = packed->nwords = packed->nblocks = 0;
+    if (packed->kind != NL_ELIAS_FANO) return;
+
+    // the first few newlines complete the block the index is in the middle of, and whatever is left after the last whole block starts the
+    // next one. both of those are appended the ordinary way.
+    size_t head = (NL_EF_BLOCK - rank % NL_EF_BLOCK) % NL_EF_BLOCK;
+    if (head >= cnt) return;
+    for (; cnt - head >= NL_EF_BLOCK; head += NL_EF_BLOCK) {
+        efSealBlock(packed, pos + head);
+        packed->n += NL_EF_BLOCK;
+    }
+}
+
+void nlIndexAppendPacked(struct nlIndex *ix, const size_t *pos, size_t cnt, size_t upto, struct nlIndex *packed) {
+    if (packed->n == 0) {
+        nlIndexAppend(ix, pos, cnt, upto);
+        return;
+    }
+
+    size_t head = (NL_EF_BLOCK - ix->v.n) % NL_EF_BLOCK, i;
+    nlIndexAppend(ix, pos, head, upto);
+
+    efReserve(ix, packed->nwords);
+    memcpy(ix->bits + ix->nwords, packed->bits, packed->nwords * sizeof(uint64_t));
+    for (i = 0; i < packed->nblocks; i++) {
+        struct efBlock *b = efNewBlock(ix);
+        *b = packed->blocks[i];
+        b->upper += ix->nwords;
+        b->lower += ix->nwords;
+    }
+    ix->nwords += packed->nwords;
+    ix->n += packed->n;
+
+    nlIndexAppend(ix, pos + head + packed->n, cnt - head - packed->n, upto);
+}
+
+// indexes the newlines in len bytes of text at position base
+void nlIndexCollect(struct nlIndex *ix, const char *s, size_t len, size_t base) {
+    if (ix->kind == NL_DENSE) {
+        nlCollect(s, len, base, &ix->v);
+        ix->n = ix->v.n;
+        return;
+    }
+    struct offsetVec found = {NULL, 0, 0};
+    nlCollect(s, len, base, &found);
+    nlIndexAppend(ix, found.v, found.n, base + len);
+    ovFree(&found);
+}
+
+// the last checkpoint at or before position pos
+size_t nlIndexCheckpointAt(struct nlIndex *ix, size_t pos) {
+    size_t lo = 0, hi = ix->cpoff.n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ix->cpoff.v[mid] <= pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+// the number of '\n' bytes before position pos, which must lie within the indexed text
+size_t nlIndexRank(struct nlIndex *ix, size_t pos) {
+    if (ix->kind == NL_SPARSE) {
+        size_t cp = nlIndexCheckpointAt(ix, pos);
+        return ix->cprank.v[cp] + nlCount(ix->text + ix->cpoff.v[cp], pos - ix->cpoff.v[cp]);
+    }
+    if (ix->kind == NL_DENSE) return ovRank(&ix->v, pos);
+
+    // the newlines below pos are all in the blocks that start below it, and only the last of those can also hold some that aren't
+    size_t lo = 0, hi = ix->nblocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ix->blocks[mid].base < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return ix->nblocks == 0 ? ovRank(&ix->v, pos) : 0;
+    size_t r = efBlockRank(ix, lo - 1, pos);
+    if (lo == ix->nblocks && r == NL_EF_BLOCK) r += ovRank(&ix->v, pos);
+    return (lo - 1) * NL_EF_BLOCK + r;
+}
+
+// the position of the k-th '\n' (counting from 0), which must already be indexed. the sparse form scans from the closest checkpoint, or from
+// where the previous lookup ended if that is closer, which is what makes drawing consecutive lines cheap.
+size_t nlIndexSelect(struct nlIndex *ix, size_t k) {
+    if (ix->kind == NL_DENSE) return ix->v.v[k];
+    if (ix->kind == NL_ELIAS_FANO) {
+        if (k / NL_EF_BLOCK == ix->nblocks) return ix->v.v[k % NL_EF_BLOCK];
+        return efBlockGet(ix, k / NL_EF_BLOCK, k % NL_EF_BLOCK);
+    }
+
+    size_t lo = 0, hi = ix->cprank.n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ix->cprank.v[mid] <= k) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t rank = ix->cprank.v[lo - 1], pos = ix->cpoff.v[lo - 1];
+    if (ix->hintrank <= k && ix->hintrank > rank) {
+        rank = ix->hintrank;
+        pos = ix->hintpos;
+    }
+
+    // the next checkpoint is less than NL_CP_BYTES further on and has a higher rank, so the newline is somewhere before it
+    size_t len = ix->textlen - pos < NL_CP_BYTES ? ix->textlen - pos : NL_CP_BYTES;
+    pos += nlFindNth(ix->text + pos, len, k - rank);
+    ix->hintrank = k + 1;
+    ix->hintpos = pos + 1;
+    return pos;
+}
+
+void nlIndexFree(struct nlIndex *ix) {
+    ovFree(&ix->v);
+    ovFree(&ix->cpoff);
+    ovFree(&ix->cprank);
+    free(ix->bits);
+    free(ix->blocks);
+    ix->bits = NULL;
+    ix->blocks = NULL;
+    ix->nwords = ix->wordcap = ix->nblocks = ix->blockcap = 0;
+}
+
+/*** piece table ***/
+
+const char *ptSourceData(struct pieceTable *pt, int src) {
+    return src == PT_ORIG ? pt->orig : pt->add;
+}
+
+struct nlIndex *ptSourceIndex(struct pieceTable *pt, int src) {
+    return src == PT_ORIG ? &pt->orignl : &pt->addnl;
+}
+
+// the number of '\n' bytes in a buffer that sit before position pos. the indexing thread may already have published newlines past
+// origfrontier, but the tree doesn't count those yet, so neither does this.
+size_t ptSourceRank(struct pieceTable *pt, int src, size_t pos) {
+    if (src == PT_ORIG && pos > pt->origfrontier) pos = pt->origfrontier;
+    return nlIndexRank(ptSourceIndex(pt, src), pos);
+}
+
+size_t ptSourceNewlines(struct pieceTable *pt, int src, size_t start, size_t len) {
+    return ptSourceRank(pt, src, start + len) - ptSourceRank(pt, src, start);
+}
+
+// priorities only need to be spread out, not unpredictable, so a xorshift generator is plenty
+unsigned ptRandom() {
+    static unsigned state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+ptNode *ptNodeNew(struct pieceTable *pt, int src, size_t start, size_t len) {
+    ptNode *t = malloc(sizeof(ptNode));
+    if (t == NULL) die("malloc");
+    t->src = src;
+    t->start = start;
+    t->len = len;
+    t->nl = ptSourceNewlines(pt, src, start, len);
+    t->sumlen = len;
+    t->sumnl = t->nl;
+    t->prio = ptRandom();
+    t->left = t->right = NULL;
+    return t;
+}
+
+size_t ptSumLen(ptNode *t) {
+    return t ? t->sumlen : 0;
+}
+
+size_t ptSumNewlines(ptNode *t) {
+    return t ? t->sumnl : 0;
+}
+
+// recomputes a node's subtree totals after its children or its own piece changed
+void ptUpdate(ptNode *t) {
+    t->sumlen = ptSumLen(t->left) + t->len + ptSumLen(t->right);
+    t->sumnl = ptSumNewlines(t->left) + t->nl + ptSumNewlines(t->right);
+}
+
+// splits the tree into everything before document offset off and everything from off onwards. when off falls inside a piece, that piece is cut
+// in two; the new right half takes over the old piece's priority, which keeps the heap order intact since it ends up above the old piece's
+// right subtree.
+void ptSplit(struct pieceTable *pt, ptNode *t, size_t off, ptNode **l, ptNode **r) {
+    if (t == NULL) {
+        *l = *r = NULL;
+        return;
+    }
+
+    size_t leftlen = ptSumLen(t->left);
+    if (off <= leftlen) {
+        ptSplit(pt, t->left, off, l, &t->left);
+        *r = t;
+    } else if (off >= leftlen + t->len) {
+        ptSplit(pt, t->right, off - leftlen - t->len, &t->right, r);
+        *l = t;
+    } else {
+        size_t inner = off - leftlen;
+        ptNode *right = ptNodeNew(pt, t->src, t->start + inner, t->len - inner);
+        right->prio = t->prio;
+        right->right = t->right;
+        t->right = NULL;
+        t->len = inner;
+        t->nl -= right->nl;
+        ptUpdate(right);
+        *l = t;
+        *r = right;
+    }
+    ptUpdate(t);
+}
+
+// joins two trees where every piece of l comes before every piece of r
+ptNode *ptMerge(ptNode *l, ptNode *r) {
+    if (l == NULL) return r;
+    if (r == NULL) return l;
+    if (l->prio >= r->prio) {
+        l->right = ptMerge(l->right, r);
+        ptUpdate(l);
+        return l;
+    } else {
+        r->left = ptMerge(l, r->left);
+        ptUpdate(r);
+        return r;
+    }
+}
+
+void ptFreeTree(ptNode *t) {
+    if (t == NULL) return;
+    ptFreeTree(t->left);
+    ptFreeTree(t->right);
+    free(t);
+}
+
+// starts the table off as a single piece covering the whole original buffer. the buffer is borrowed, not copied, and orignl must already hold
+// the newline offsets of its first indexed bytes.
+void ptInit(struct pieceTable *pt, const char *orig, size_t len, size_t indexed) {
+    pt->orig = orig;
+    pt->origlen = len;
+    pt->origfrontier = indexed;
+    pt->knownlen = indexed;
+    pt->len = len;
+    pt->root = len > 0 ? ptNodeNew(pt, PT_ORIG, 0, len) : NULL;
+}
+
+// recounts the newlines of every original piece the old frontier cut short, and works out where the new frontier lands in the document. the
+// original pieces appear in the document in the same order as in the file, so it is at the first one that isn't fully indexed.
+void ptRecountTree(struct pieceTable *pt, ptNode *t, size_t oldfrontier, size_t *docpos, int *found) {
+    if (t == NULL) return;
+    ptRecountTree(pt, t->left, oldfrontier, docpos, found);
+    if (t->src == PT_ORIG && t->start + t->len > oldfrontier) {
+        t->nl = ptSourceNewlines(pt, PT_ORIG, t->start, t->len);
+    }
+    if (!*found && t->src == PT_ORIG && t->start + t->len > pt->origfrontier) {
+        pt->knownlen = *docpos + (pt->origfrontier > t->start ? pt->origfrontier - t->start : 0);
+        *found = 1;
+    }
+    *docpos += t->len;
+    ptRecountTree(pt, t->right, oldfrontier, docpos, found);
+    ptUpdate(t);
+}
+
+// moves the frontier forward once the indexing thread has published more of orignl. this visits every piece, but there are only as many of
+// those as there have been edits, and it runs once per published chunk rather than once per edit.
+void ptSetOrigFrontier(struct pieceTable *pt, size_t frontier) {
+    size_t old = pt->origfrontier;
+    size_t docpos = 0;
+    int found = 0;
+
+    pt->origfrontier = frontier;
+    ptRecountTree(pt, pt->root, old, &docpos, &found);
+    if (!found) pt->knownlen = pt->len;
+}
+
+// moves the add buffer out of the heap into a scratch file mapped shared. the file is unlinked straight away, so it disappears with the
+// editor, and from then on the kernel can write add buffer pages back to disk and drop them instead of running out of memory. that only
+// works on a real disk: on tmpfs, which $TMPDIR and /tmp often are, the pages stay in memory and count against it just the same. so the file
+// goes in spilldir, and failing that in /var/tmp.
+void ptSpillAdd(struct pieceTable *pt, size_t cap) {
+    const char *dirs[2] = {pt->spilldir, "/var/tmp"};
+    char path[4096];
+    int fd = -1, i;
+    for (i = 0; i < 2 && fd == -1; i++) {
+        if (dirs[i] == NULL) continue;
+        snprintf(path, sizeof(path), "%s/ed-scratch-XXXXXX", dirs[i]);
+        fd = mkstemp(path);
+    }
+    if (fd == -1) die("mkstemp");
+    unlink(path);
+    if (ftruncate(fd, cap) == -1) die("ftruncate");
+
+    char *p = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) die("mmap");
+    memcpy(p, pt->add, pt->addlen);
+    free(pt->add);
+    pt->add = p;
+    pt->addfd = fd;
+}
+
+// copies s onto the end of the add buffer and returns where it landed. the add buffer only ever grows, so existing pieces stay valid.
+size_t ptAppendAdd(struct pieceTable *pt, const char *s, size_t len) {
+    if (pt->addlen + len > pt->addcap) {
+        size_t cap = pt->addcap ? pt->addcap : 4096;
+        while (cap < pt->addlen + len) cap *= 2;
+        if (pt->addfd != -1) {
+            // already spilled: grow the file, then the mapping
+            if (ftruncate(pt->addfd, cap) == -1) die("ftruncate");
+            char *new = mremap(pt->add, pt->addcap, cap, MREMAP_MAYMOVE);
+            if (new == MAP_FAILED) die("mremap");
+            pt->add = new;
+        } else if (pt->spill && cap > pt->spill) {
+            ptSpillAdd(pt, cap);
+        } else {
+            char *new = realloc(pt->add, cap);
+            if (new == NULL) die("realloc");
+            pt->add = new;
+        }
+        pt->addcap = cap;
+    }
+    size_t start = pt->addlen;
+    memcpy(&pt->add[start], s, len);
+    nlIndexCollect(&pt->addnl, s, len, start);
+    pt->addlen += len;
+    // writing makes pages resident just like reading does, so a spilled add buffer counts its writes toward what the next trim looks at
+    if (start < pt->touchlo[PT_ADD]) pt->touchlo[PT_ADD] = start;
+    if (start + len > pt->touchhi[PT_ADD]) pt->touchhi[PT_ADD] = start + len;
+    return start;
+}
+
+// grows the last piece of the tree by len bytes if it is an add piece ending exactly at start, and reports whether it did
+int ptExtendLast(struct pieceTable *pt, ptNode *t, size_t start, size_t len) {
+    if (t == NULL) return 0;
+    if (t->right != NULL) {
+        if (!ptExtendLast(pt, t->right, start, len)) return 0;
+    } else {
+        if (t->src != PT_ADD || t->start + t->len != start) return 0;
+        t->len += len;
+        t->nl += ptSourceNewlines(pt, PT_ADD, start, len);
+    }
+    ptUpdate(t);
+    return 1;
+}
+
+void ptInsert(struct pieceTable *pt, size_t off, const char *s, size_t len) {
+    if (len == 0) return;
+    if (off > pt->len) off = pt->len;
+
+    size_t start = ptAppendAdd(pt, s, len);
+    ptNode *l, *r;
+    ptSplit(pt, pt->root, off, &l, &r);
+
+    // typing appends to the add buffer right after the previous keystroke, so the piece before the cursor can usually just grow instead of
+    // the tree gaining one piece per character.
+    if (!ptExtendLast(pt, l, start, len)) {
+        l = ptMerge(l, ptNodeNew(pt, PT_ADD, start, len));
+    }
+    pt->root = ptMerge(l, r);
+    pt->len += len;
+    // inserted text is always indexed, so text landing inside the known region keeps it contiguous
+    if (off <= pt->knownlen) pt->knownlen += len;
+}
+
+// cuts the deleted range out as its own tree, throws it away, and joins what was on either side of it
+void ptDelete(struct pieceTable *pt, size_t off, size_t len) {
+    if (off >= pt->len) return;
+    if (len > pt->len - off) len = pt->len - off;
+
+    ptNode *l, *mid, *r;
+    ptSplit(pt, pt->root, off, &l, &r);
+    ptSplit(pt, r, len, &mid, &r);
+    ptFreeTree(mid);
+    pt->root = ptMerge(l, r);
+    pt->len -= len;
+    if (off + len <= pt->knownlen) {
+        pt->knownlen -= len;
+    } else if (off < pt->knownlen) {
+        pt->knownlen = off;
+    }
+}
+
+// the budget bookkeeping: every read of buffer text goes through ptTouch, which widens both the range read since the last trim and the range
+// read for the current frame.
+void ptTouch(struct pieceTable *pt, int src, size_t start, size_t len) {
+    if (start < pt->touchlo[src]) pt->touchlo[src] = start;
+    if (start + len > pt->touchhi[src]) pt->touchhi[src] = start + len;
+    if (start < pt->framelo[src]) pt->framelo[src] = start;
+    if (start + len > pt->framehi[src]) pt->framehi[src] = start + len;
+}
+
+void ptFrameReset(struct pieceTable *pt) {
+    pt->framelo[PT_ORIG] = pt->framelo[PT_ADD] = (size_t) -1;
+    pt->framehi[PT_ORIG] = pt->framehi[PT_ADD] = 0;
+}
+
+void ptTouchReset(struct pieceTable *pt) {
+    pt->touchlo[PT_ORIG] = pt->touchlo[PT_ADD] = (size_t) -1;
+    pt->touchhi[PT_ORIG] = pt->touchhi[PT_ADD] = 0;
+    ptFrameReset(pt);
+}
+
+// how many bytes of mapped buffers have been read since the last trim, which is an upper bound on what they can be holding resident
+size_t ptTouched(struct pieceTable *pt) {
+    size_t total = 0;
+    if (pt->touchhi[PT_ORIG] > pt->touchlo[PT_ORIG]) total += pt->touchhi[PT_ORIG] - pt->touchlo[PT_ORIG];
+    if (pt->addfd != -1 && pt->touchhi[PT_ADD] > pt->touchlo[PT_ADD]) total += pt->touchhi[PT_ADD] - pt->touchlo[PT_ADD];
+    return total;
+}
+
+// hands the pages of a mapped range back to the kernel. clean pages of the file mapping are simply dropped and read back in if they are touched
+// again, and pages of the scratch file get written out first. madvise() wants page aligned ranges, and rounding inwards only ever keeps a
+// partial page more than needed.
+void ptRelease(const char *base, size_t from, size_t to) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    from = (from + page - 1) / page * page;
+    to = to / page * page;
+    if (from < to) madvise((char *) base + from, to - from, MADV_DONTNEED);
+}
+
+// releases everything read since the last trim except what the current frame used plus keep bytes either side of it. the add buffer only
+// takes part once it has spilled, since heap memory can't be given back this way.
+void ptTrim(struct pieceTable *pt, size_t keep) {
+    int src;
+    for (src = PT_ORIG; src <= PT_ADD; src++) {
+        const char *base = ptSourceData(pt, src);
+        size_t lo = pt->touchlo[src], hi = pt->touchhi[src];
+        if (src == PT_ADD && pt->addfd == -1) continue;
+        if (lo >= hi) continue;
+
+        size_t keeplo = 0, keephi = 0;
+        if (pt->framelo[src] < pt->framehi[src]) {
+            keeplo = pt->framelo[src] > keep ? pt->framelo[src] - keep : 0;
+            keephi = pt->framehi[src] + keep;
+        }
+
+        if (keeplo >= keephi || keephi <= lo || keeplo >= hi) {
+            ptRelease(base, lo, hi);
+            pt->touchlo[src] = (size_t) -1;
+            pt->touchhi[src] = 0;
+            continue;
+        }
+        if (lo < keeplo) ptRelease(base, lo, keeplo);
+        if (hi > keephi) ptRelease(base, keephi, hi);
+        pt->touchlo[src] = lo > keeplo ? lo : keeplo;
+        pt->touchhi[src] = hi < keephi ? hi : keephi;
+    }
+}
+
+// copies up to n bytes starting at offset off into the subtree, and returns how many were copied
+size_t ptReadTree(struct pieceTable *pt, ptNode *t, size_t off, char *dst, size_t n) {
+    size_t copied = 0;
+    if (t == NULL || n == 0) return 0;
+
+    size_t leftlen = ptSumLen(t->left);
+    if (off < leftlen) {
+        copied = ptReadTree(pt, t->left, off, dst, n);
+    }
+    // off + copied is where the next byte comes from, whether or not the left subtree supplied any
+    if (copied < n && off + copied < leftlen + t->len) {
+        size_t inner = off + copied - leftlen;
+        size_t take = t->len - inner;
+        if (take > n - copied) take = n - copied;
+        memcpy(dst + copied, ptSourceData(pt, t->src) + t->start + inner, take);
+        ptTouch(pt, t->src, t->start + inner, take);
+        copied += take;
+    }
+    if (copied < n) {
+        copied += ptReadTree(pt, t->right, off + copied - leftlen - t->len, dst + copied, n - copied);
+    }
+    return copied;
+}
+
+// copies up to n bytes starting at document offset off into dst, and returns how many were copied.
+size_t ptRead(struct pieceTable *pt, size_t off, char *dst, size_t n) {
+    if (off >= pt->len) return 0;
+    return ptReadTree(pt, pt->root, off, dst, n);
+}
+
+// the number of lines, which is only the real total once the original buffer is fully indexed
+size_t ptLineCount(struct pieceTable *pt) {
+    return ptSumNewlines(pt->root) + 1;
+}
+
+// the offset of the first '\n' at or after off, or the document length if there is none. these scan the text itself, for the places where the
+// line index can't help yet.
+size_t ptFindForward(struct pieceTable *pt, size_t off) {
+    char buf[16384];
+    size_t n;
+    while ((n = ptRead(pt, off, buf, sizeof(buf))) > 0) {
+        char *nl = memchr(buf, '\n', n);
+        if (nl != NULL) return off + (nl - buf);
+        off += n;
+    }
+    return pt->len;
+}
+
+// the offset of the last '\n' before off, or -1 if there is none
+size_t ptFindBackward(struct pieceTable *pt, size_t off) {
+    char buf[16384];
+    while (off > 0) {
+        size_t n = off < sizeof(buf) ? off : sizeof(buf);
+        ptRead(pt, off - n, buf, n);
+        char *nl = memrchr(buf, '\n', n);
+        if (nl != NULL) return off - n + (nl - buf);
+        off -= n;
+    }
+    return (size_t) -1;
+}
+
+size_t ptCountNewlines(struct pieceTable *pt, size_t off, size_t len) {
+    char buf[16384];
+    size_t count = 0;
+    while (len > 0) {
+        size_t n = ptRead(pt, off, buf, len < sizeof(buf) ? len : sizeof(buf));
+        if (n == 0) break;
+        count += nlCount(buf, n);
+        off += n;
+        len -= n;
+    }
+    return count;
+}
+
+// returns the document offset of the first byte of the given line, which the caller must make sure exists. line n starts right after the
+// document's n-th '\n', so this walks down to the piece holding that newline, steering by the subtree newline counts, and then looks the newline
+// up in the piece's buffer.
+size_t ptLineStart(struct pieceTable *pt, size_t line) {
+    ptNode *t = pt->root;
+    size_t off = 0;
+
+    if (line == 0) return 0;
+    while (t != NULL) {
+        size_t leftnl = ptSumNewlines(t->left);
+        if (line <= leftnl) {
+            t = t->left;
+        } else if (line <= leftnl + t->nl) {
+            line -= leftnl;
+            size_t pos = nlIndexSelect(ptSourceIndex(pt, t->src), ptSourceRank(pt, t->src, t->start) + line - 1);
+            return off + ptSumLen(t->left) + (pos - t->start) + 1;
+        } else {
+            line -= leftnl + t->nl;
+            off += ptSumLen(t->left) + t->len;
+            t = t->right;
+        }
+    }
+    return pt->len;
+}
+
+// returns the line that document offset off falls on, which is the number of '\n' bytes before it
+size_t ptLineOf(struct pieceTable *pt, size_t off) {
+    ptNode *t = pt->root;
+    size_t line = 0;
+
+    while (t != NULL) {
+        size_t leftlen = ptSumLen(t->left);
+        if (off < leftlen) {
+            t = t->left;
+        } else if (off < leftlen + t->len) {
+            return line + ptSumNewlines(t->left) + ptSourceNewlines(pt, t->src, t->start, off - leftlen);
+        } else {
+            off -= leftlen + t->len;
+            line += ptSumNewlines(t->left) + t->nl;
+            t = t->right;
+        }
+    }
+    return line;
+}
+
+void ptFree(struct pieceTable *pt) {
+    ptFreeTree(pt->root);
+    if (pt->addfd != -1) {
+        munmap(pt->add, pt->addcap);
+        close(pt->addfd);
+    } else {
+        free(pt->add);
+    }
+    nlIndexFree(&pt->orignl);
+    nlIndexFree(&pt->addnl);
+}
+
+/*** background indexing ***/
+
+#define INDEX_CHUNK (16 << 20)
+#define INDEX_MAX_THREADS 64
+// the most the first screen is indexed for before the editor starts. a file with few newlines has its first screen's lines found as they
+// are drawn instead, and the rest of the scan goes to the indexing thread.
+#define INDEX_FIRST_MAX (4 << 20)
+
+double editorNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the scan is spread over every core. workers take chunks in file order from a shared counter and collect each chunk's newlines into a slot of
+ * their own. the offsets are absolute, so nothing in them has to be adjusted: the chunks only have to be stitched together in order, which
+ * the calling thread does as chunk after chunk comes in. a worker can run at most nslots chunks ahead of it, which bounds how much of the
+ * file is in flight at once.
+ *
+ * stitching has to stay cheap, or the one thread doing it caps the speedup however many cores there are. so once a chunk's first line number
+ * is known, which is the running total of the counts of the chunks before it, a worker also packs that chunk's share of the index ahead of
+ * time (see nlIndexPack()), and the stitching is then mostly a copy. */
+
+enum indexSlotState {
+    SLOT_COLLECTING = 0,
+    SLOT_COLLECTED,
+    SLOT_PACKED
+};
+
+struct indexSlot {
+    int state;
+    struct offsetVec found;
+    // the number of newlines before the chunk, and its newlines packed the way the index being built stores them
+    size_t rank;
+    struct nlIndex packed;
+};
+
+struct indexScan {
+    const char *text;
+    size_t from, to;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // the next chunk to collect, the next to pack, the first whose line number isn't known yet, and the first not yet stitched
+    size_t next, packnext, ranked, stitched, nchunks;
+    // the number of newlines before chunk ranked
+    size_t rank;
+    struct indexSlot *slots;
+    size_t nslots;
+};
+
+void nlScanChunk(struct indexScan *sc, size_t c, size_t *start, size_t *end) {
+    *start = sc->from + c * INDEX_CHUNK;
+    *end = sc->to - *start < INDEX_CHUNK ? sc->to : *start + INDEX_CHUNK;
+}
+
+void *nlScanWorker(void *arg) {
+    struct indexScan *sc = arg;
+    size_t c, start, end;
+
+    pthread_mutex_lock(&sc->lock);
+    for (;;) {
+        // packing comes first, since the chunks waiting to be stitched are the ones the caller is waiting for
+        if (sc->packnext < sc->ranked) {
+            struct indexSlot *slot = &sc->slots[(c = sc->packnext++) % sc->nslots];
+            pthread_mutex_unlock(&sc->lock);
+            nlIndexPack(&slot->packed, slot->rank, slot->found.v, slot->found.n);
+            pthread_mutex_lock(&sc->lock);
+            slot->state = SLOT_PACKED;
+            pthread_cond_broadcast(&sc->cond);
+        } else if (sc->next < sc->nchunks && sc->next < sc->stitched + sc->nslots) {
+            struct indexSlot *slot = &sc->slots[(c = sc->next++) % sc->nslots];
+            pthread_mutex_unlock(&sc->lock);
+            nlScanChunk(sc, c, &start, &end);
+            slot->found.n = 0;
+            nlCollect(sc->text + start, end - start, start, &slot->found);
+            pthread_mutex_lock(&sc->lock);
+            slot->state = SLOT_COLLECTED;
+            // this may have been the chunk holding up the line numbers of the ones after it
+            while (sc->ranked < sc->next && sc->slots[sc->ranked % sc->nslots].state == SLOT_COLLECTED) {
+                struct indexSlot *r = &sc->slots[sc->ranked++ % sc->nslots];
+                r->rank = sc->rank;
+                sc->rank += r->found.n;
+            }
+            pthread_cond_broadcast(&sc->cond);
+        } else if (sc->next >= sc->nchunks && sc->packnext >= sc->nchunks) {
+            break;
+        } else {
+            pthread_cond_wait(&sc->cond, &sc->lock);
+        }
+    }
+    pthread_mutex_unlock(&sc->lock);
+    return NULL;
+}
+
+// collects the newlines in text[from, to) on nthreads threads, and passes each chunk's to chunk(), in file order, from the calling thread.
+// they come packed for an index of the given kind that has rank newlines in it so far, ready for nlIndexAppendPacked(). chunk() returns
+// nonzero to stop the scan early.
+void nlScanParallel(const char *text, size_t from, size_t to, int nthreads, int kind, size_t rank,
+                    int (*chunk)(void *arg, const struct offsetVec *found, struct nlIndex *packed, size_t start, size_t end), void *arg) {
+    struct indexScan sc;
+    size_t start, end;
+    int i;
+
+    sc.text = text;
+    sc.from = from;
+    sc.to = to;
+    sc.next = sc.packnext = sc.ranked = sc.stitched = 0;
+    sc.nchunks = (to - from + INDEX_CHUNK - 1) / INDEX_CHUNK;
+    sc.rank = rank;
+    // two chunks per worker keep everyone busy while the caller is catching up on one of them
+    sc.nslots = nthreads * 2;
+    sc.slots = calloc(sc.nslots, sizeof(struct indexSlot));
+    pthread_t *workers = malloc(nthreads * sizeof(pthread_t));
+    if (sc.slots == NULL || workers == NULL) die("malloc");
+    for (i = 0; i < (int) sc.nslots; i++) sc.slots[i].packed.kind = kind;
+    pthread_mutex_init(&sc.lock, NULL);
+    pthread_cond_init(&sc.cond, NULL);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&workers[i], NULL, nlScanWorker, &sc) != 0) die("pthread_create");
+    }
+
+    while (sc.stitched < sc.nchunks) {
+        struct indexSlot *slot = &sc.slots[sc.stitched % sc.nslots];
+        pthread_mutex_lock(&sc.lock);
+        while (slot->state != SLOT_PACKED) pthread_cond_wait(&sc.cond, &sc.lock);
+        pthread_mutex_unlock(&sc.lock);
+
+        nlScanChunk(&sc, sc.stitched, &start, &end);
+        int stop = chunk(arg, &slot->found, &slot->packed, start, end);
+
+        pthread_mutex_lock(&sc.lock);
+        slot->state = SLOT_COLLECTING;
+        sc.stitched++;
+        // giving up just means handing out no more chunks. the workers finish the ones they have and leave.
+        if (stop) sc.nchunks = sc.next;
+        pthread_cond_broadcast(&sc.cond);
+        pthread_mutex_unlock(&sc.lock);
+        if (stop) break;
+    }
+
+    for (i = 0; i < nthreads; i++) pthread_join(workers[i], NULL);
+    for (i = 0; i < (int) sc.nslots; i++) {
+        ovFree(&sc.slots[i].found);
+        nlIndexFree(&sc.slots[i].packed);
+    }
+    pthread_mutex_destroy(&sc.lock);
+    pthread_cond_destroy(&sc.cond);
+    free(workers);
+    free(sc.slots);
+}
+
+// how many threads to scan with: one per core, but under a memory budget no more than keeps the chunks in flight within a quarter of it,
+// since every one of them is resident until it has been counted
+int editorIndexThreads() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > INDEX_MAX_THREADS) n = INDEX_MAX_THREADS;
+    if (E.budget) {
+        long fit = E.budget / 4 / (2 * (size_t) INDEX_CHUNK);
+        if (n > fit) n = fit > 0 ? fit : 1;
+    }
+    return n;
+}
+
+// takes one scanned chunk into orignl. the editor is told about progress at most ten times a second, which is plenty for a progress
+// readout and keeps it from redrawing on every chunk.
+int editorIndexChunk(void *arg, const struct offsetVec *found, struct nlIndex *packed, size_t start, size_t end) {
+    struct pieceTable *pt = arg;
+    static double lastpoke = 0;
+
+    pthread_mutex_lock(&E.idx.lock);
+    nlIndexAppendPacked(&pt->orignl, found->v, found->n, end, packed);
+    E.idx.scanned = end;
+    // under a memory budget the scan doesn't leave the whole file behind it in memory: each chunk is dropped once counted, unless the
+    // screen is showing part of it
+    if (E.budget && (end <= pt->framelo[PT_ORIG] || start >= pt->framehi[PT_ORIG])) ptRelease(pt->orig, start, end);
+    pthread_mutex_unlock(&E.idx.lock);
+
+    double now = editorNow();
+    if (now - lastpoke >= 0.1 || end == pt->origlen) {
+        // the pipe is non-blocking, and if it is already full the editor has a wakeup pending anyway
+        if (write(E.idx.pipe[1], "i", 1) == -1 && errno != EAGAIN) return 1;
+        lastpoke = now;
+    }
+    return 0;
+}
+
+// scans the rest of the original buffer, with the lock held only while each chunk's newlines are appended
+void *editorIndexThread(void *arg) {
+    struct pieceTable *pt = arg;
+    // nothing else appends to orignl while this runs, so its kind and count can be read without the lock
+    nlScanParallel(pt->orig, E.idx.scanned, pt->origlen, editorIndexThreads(), pt->orignl.kind, pt->orignl.n, editorIndexChunk, pt);
+    return NULL;
+}
+
+// indexes just enough of the file synchronously to draw the first screen, up to INDEX_FIRST_MAX, and hands the rest to the indexing thread
+void editorIndexStart() {
+    struct pieceTable *pt = &E.pt;
+    size_t pos = 0;
+
+    while (pos < pt->origlen && pos < INDEX_FIRST_MAX && pt->orignl.n <= (size_t) E.screenrows) {
+        size_t end = pos + 65536 < pt->origlen ? pos + 65536 : pt->origlen;
+        nlIndexCollect(&pt->orignl, pt->orig + pos, end - pos, pos);
+        pos = end;
+    }
+    E.idx.scanned = pos;
+    ptSetOrigFrontier(pt, pos);
+
+    if (pos < pt->origlen) {
+        if (pthread_create(&E.idx.thread, NULL, editorIndexThread, pt) != 0) die("pthread_create");
+        E.idx.running = 1;
+    }
+}
+
+// called on the editor's side, with the lock held, to fold whatever the thread has published into the piece table. if the view was placed by
+// estimate and the real line numbers have now caught up with the anchor, everything numbered relative to the estimate shifts to the true
+// numbers at once, which doesn't move anything on screen.
+void editorIndexProgress() {
+    if (E.idx.scanned == E.pt.origfrontier) return;
+
+    ptSetOrigFrontier(&E.pt, E.idx.scanned);
+
+    if (E.anchored && E.anchoroff <= E.pt.knownlen) {
+        size_t base = editorExactLines(), exact = ptLineOf(&E.pt, E.anchoroff);
+        if (E.cy > base) E.cy = E.cy - E.anchorline + exact;
+        if (E.rowoff > base) E.rowoff = E.rowoff - E.anchorline + exact;
+        E.anchored = 0;
+    }
+
+    if (E.idx.running && E.idx.scanned == E.pt.origlen) {
+        pthread_join(E.idx.thread, NULL);
+        E.idx.running = 0;
+    }
+}
+
+/*** frame ***/
+
+// starts a new frame with room for the given number of pieces
+void frameReset(struct frame *f, int pieces) {
+    f->n = 0;
+    f->len = 0;
+    f->escblock = 0;
+    f->escused = 0;
+    f->first = 0;
+    f->sent = 0;
+    f->ncuts = 0;
+    if (pieces > f->cap) {
+        f->cap = pieces;
+        f->iov = realloc(f->iov, f->cap * sizeof(struct iovec));
+        if (f->iov == NULL) die("realloc");
+    }
+}
+
+// adds len bytes at s, which have to stay put until the frame is written. bytes that carry straight on from the previous piece just
+// lengthen it.
+void frameAdd(struct frame *f, const char *s, int len) {
+    if (len == 0) return;
+    f->len += len;
+    if (f->n > 0 && (char *) f->iov[f->n - 1].iov_base + f->iov[f->n - 1].iov_len == s) {
+        f->iov[f->n - 1].iov_len += len;
+        return;
+    }
+    if (f->n == f->cap) {
+        f->cap = f->cap ? f->cap * 2 : 256;
+        f->iov = realloc(f->iov, f->cap * sizeof(struct iovec));
+        if (f->iov == NULL) die("realloc");
+    }
+    f->iov[f->n].iov_base = (char *) s;
+    f->iov[f->n].iov_len = len;
+    f->n++;
+}
+
+// adds a copy of len bytes at s, for escape sequences formatted on the stack
+void frameAddCopy(struct frame *f, const char *s, int len) {
+    if (f->escused + len > FRAME_ESC_BLOCK) {
+        f->escblock++;
+        f->escused = 0;
+    }
+    if (f->escblock == f->nesc) {
+        f->esc = realloc(f->esc, (f->nesc + 1) * sizeof(char *));
+        if (f->esc == NULL) die("realloc");
+        f->esc[f->nesc] = malloc(FRAME_ESC_BLOCK);
+        if (f->esc[f->nesc] == NULL) die("malloc");
+        f->nesc++;
+    }
+    char *p = &f->esc[f->escblock][f->escused];
+    memcpy(p, s, len);
+    f->escused += len;
+    frameAdd(f, p, len);
+}
+
+// notes that the frame can be cut short where it has got to
+void frameMark(struct frame *f) {
+    if (f->ncuts == f->cutcap) {
+        f->cutcap = f->cutcap ? f->cutcap * 2 : 64;
+        f->cuts = realloc(f->cuts, f->cutcap * sizeof(size_t));
+        if (f->cuts == NULL) die("realloc");
+    }
+    f->cuts[f->ncuts++] = f->len;
+}
+
+// writes as much of the frame as fd takes without blocking, at most IOV_MAX pieces at a time, and picks up where that left off the next
+// time. returns 1 once all of it is out, or it can't be written at all, and 0 when the terminal has to catch up first.
+int frameSend(struct frame *f, int fd) {
+    while (f->first < f->n) {
+        struct iovec *iov = &f->iov[f->first];
+        int n = f->n - f->first;
+        ssize_t w = writev(fd, iov, n < IOV_MAX ? n : IOV_MAX);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return errno != EAGAIN;
+        }
+        f->sent += w;
+        while (f->first < f->n && (size_t) w >= iov->iov_len) {
+            w -= iov->iov_len;
+            iov++;
+            f->first++;
+        }
+        if (f->first < f->n) {
+            iov->iov_base = (char *) iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 1;
+}
+
+// drops everything in the frame after its first len bytes, which can't be any fewer than have been sent
+void frameCut(struct frame *f, size_t len) {
+    size_t off = f->sent;
+    int i;
+    for (i = f->first; i < f->n && off + f->iov[i].iov_len < len; i++) off += f->iov[i].iov_len;
+    if (i < f->n) {
+        f->iov[i].iov_len = len - off;
+        f->n = i + 1;
+    }
+    f->len = len;
+}
+
+/*** utf-8 ***/
+
+// the length of the UTF-8 sequence a byte starts, or 1 for one that can't start a sequence
+int utf8Len(unsigned char c) {
+    if (c < 0xc0) return 1;
+    if (c < 0xe0) return 2;
+    if (c < 0xf0) return 3;
+    if (c < 0xf8) return 4;
+    return 1;
+}
+
+// decodes the character that starts the n bytes at s into cp and returns how many bytes it takes up. a byte that doesn't start a whole,
+// well-formed sequence (cut short, overlong, a surrogate or past U+10FFFF) is a character of its own, with cp UTF8_INVALID.
+#define UTF8_INVALID ((unsigned) -1)
+
+int utf8Decode(const char *s, size_t n, unsigned *cp) {
+    static const unsigned least[] = {0, 0, 0x80, 0x800, 0x10000};
+    unsigned char c = s[0];
+    int len = utf8Len(c), i;
+    *cp = c < 0x80 ? c : UTF8_INVALID;
+    if (len == 1 || (size_t) len > n) return 1;
+    unsigned v = c & (0x7f >> len);
+    for (i = 1; i < len; i++) {
+        if (((unsigned char) s[i] & 0xc0) != 0x80) return 1;
+        v = v << 6 | ((unsigned char) s[i] & 0x3f);
+    }
+    if (v < least[len] || (v >= 0xd800 && v < 0xe000) || v > 0x10ffff) return 1;
+    *cp = v;
+    return len;
+}
+
+// the columns a character takes on the terminal: 1 or 2, 0 for one that combines with the character before it, and -1 for one that
+// can't be shown, like a control character or an invalid byte. past ASCII that is up to wcwidth() and the locale.
+int utf8Width(unsigned cp) {
+    if (cp < 0x80) return cp >= 0x20 && cp < 0x7f ? 1 : -1;
+    if (cp == UTF8_INVALID) return -1;
+    return wcwidth(cp);
+}
+
+// how much of the n bytes at s is whole characters: all of them, less a sequence at the end that was cut short, as when text is read a
+// piece at a time
+size_t utf8Whole(const char *s, size_t n) {
+    size_t i;
+    for (i = n; i > 0 && n - i < 3; i--) {
+        unsigned char c = s[i - 1];
+        if (c < 0x80) break;
+        if (c >= 0xc0) return (size_t) utf8Len(c) > n - i + 1 ? i - 1 : n;
+    }
+    return n;
+}
+
+/*** screen ***/
+
+// cell attributes: a few flags in the low bits, and in the high ones the foreground color, 0 for the terminal's own and otherwise one more
+// than the ANSI color number
+#define ATTR_INVERSE 1
+#define ATTR_FLAGS 0x0f
+#define ATTR_FG(color) (((color) + 1) << 4)
+#define ATTR_FG_MASK 0xf0
+
+// the bytes of the seq grids a cell has, enough for any UTF-8 sequence, and what marks the right half of a character two columns wide
+#define SCREEN_SEQ 4
+#define CELL_CONT '\0'
+
+// sizes the grids for a terminal of the given size. they are reallocated only when they have to grow, so a window being resized back and
+// forth settles on the largest size and stops allocating. what was on the terminal can't be trusted after a resize: some terminals rewrap
+// lines and some scroll on shrinking, so the next flush repaints it all.
+void screenResize(struct screen *s, int rows, int cols) {
+    if (rows * cols > s->cap) {
+        s->cap = rows * cols;
+        s->next = realloc(s->next, s->cap);
+        s->nextseq = realloc(s->nextseq, s->cap * SCREEN_SEQ);
+        s->nextattr = realloc(s->nextattr, s->cap);
+        s->shown = realloc(s->shown, s->cap);
+        s->shownseq = realloc(s->shownseq, s->cap * SCREEN_SEQ);
+        s->shownattr = realloc(s->shownattr, s->cap);
+        s->before = realloc(s->before, s->cap);
+        s->beforeseq = realloc(s->beforeseq, s->cap * SCREEN_SEQ);
+        s->beforeattr = realloc(s->beforeattr, s->cap);
+        if (s->next == NULL || s->nextseq == NULL || s->nextattr == NULL || s->shown == NULL || s->shownseq == NULL ||
+            s->shownattr == NULL || s->before == NULL || s->beforeseq == NULL || s->beforeattr == NULL) {
+            die("realloc");
+        }
+    }
+    s->rows = rows;
+    s->cols = cols;
+    s->valid = 0;
+}
+
+void screenInit(struct screen *s, int rows, int cols) {
+    free(s->next);
+    free(s->nextseq);
+    free(s->nextattr);
+    free(s->shown);
+    free(s->shownseq);
+    free(s->shownattr);
+    free(s->before);
+    free(s->beforeseq);
+    free(s->beforeattr);
+    s->next = s->nextseq = s->shown = s->shownseq = s->before = s->beforeseq = NULL;
+    s->nextattr = s->shownattr = s->beforeattr = NULL;
+    s->cap = 0;
+    screenResize(s, rows, cols);
+}
+
+// makes cell i of the new frame a blank, as what is left of a character two columns wide when something is put over its other half
+void screenUnsplit(struct screen *s, int i) {
+    s->next[i] = ' ';
+    memset(&s->nextseq[i * SCREEN_SEQ], 0, SCREEN_SEQ);
+}
+
+// fills n cells of row y from column x with c, which is ASCII
+void screenFill(struct screen *s, int y, int x, int n, char c, unsigned char attr) {
+    if (x + n > s->cols) n = s->cols - x;
+    if (n <= 0) return;
+    int i = y * s->cols + x;
+    if (x > 0 && s->next[i] == CELL_CONT) screenUnsplit(s, i - 1);
+    if (x + n < s->cols && s->next[i + n] == CELL_CONT) screenUnsplit(s, i + n);
+    memset(&s->next[i], c, n);
+    memset(&s->nextseq[i * SCREEN_SEQ], 0, n * SCREEN_SEQ);
+    memset(&s->nextattr[i], attr, n);
+}
+
+// puts the len bytes at chars in row y from column x, dropping whatever doesn't fit, each character in the attribute its first byte has
+// in attrs, or in attr when that is NULL. a character two columns wide that would stick out past the edge is shown as a blank, one that
+// combines with the character before it is left out, and one that can't be shown at all is shown as a '?'.
+void screenPutText(struct screen *s, int y, int x, const char *chars, const unsigned char *attrs, int len, unsigned char attr) {
+    int row = y * s->cols, i = 0;
+    if (len <= 0 || x >= s->cols) return;
+    if (x > 0 && s->next[row + x] == CELL_CONT) screenUnsplit(s, row + x - 1);
+    while (i < len && x < s->cols) {
+        int c = row + x, n;
+        // a run of printable ASCII goes in as it is
+        for (n = 0; i + n < len && x + n < s->cols && chars[i + n] >= 0x20 && chars[i + n] < 0x7f; n++);
+        if (n > 0) {
+            memcpy(&s->next[c], &chars[i], n);
+            memset(&s->nextseq[c * SCREEN_SEQ], 0, n * SCREEN_SEQ);
+            if (attrs) memcpy(&s->nextattr[c], &attrs[i], n);
+            else memset(&s->nextattr[c], attr, n);
+            i += n;
+            x += n;
+            continue;
+        }
+        unsigned cp;
+        unsigned char a = attrs ? attrs[i] : attr;
+        int bytes = utf8Decode(&chars[i], len - i, &cp), w = utf8Width(cp);
+        if (w == 0) {
+            i += bytes;
+            continue;
+        }
+        memset(&s->nextseq[c * SCREEN_SEQ], 0, SCREEN_SEQ);
+        s->nextattr[c] = a;
+        if (w < 0 || (w == 2 && x + 1 == s->cols)) {
+            s->next[c] = w < 0 ? '?' : ' ';
+        } else {
+            s->next[c] = chars[i];
+            memcpy(&s->nextseq[c * SCREEN_SEQ], &chars[i], bytes);
+            if (w == 2) {
+                s->next[c + 1] = CELL_CONT;
+                memset(&s->nextseq[(c + 1) * SCREEN_SEQ], 0, SCREEN_SEQ);
+                s->nextattr[c + 1] = a;
+            }
+        }
+        i += bytes;
+        x += w < 0 ? 1 : w;
+    }
+    if (x < s->cols && s->next[row + x] == CELL_CONT) screenUnsplit(s, row + x);
+}
+
+void screenPut(struct screen *s, int y, int x, const char *chars, int len, unsigned char attr) {
+    screenPutText(s, y, x, chars, NULL, len, attr);
+}
+
+// the same with a separate attribute for each character
+void screenPutAttrs(struct screen *s, int y, int x, const char *chars, const unsigned char *attrs, int len) {
+    screenPutText(s, y, x, chars, attrs, len, 0);
+}
+
+// starts a new frame, blank everywhere
+void screenClear(struct screen *s) {
+    memset(s->next, ' ', s->rows * s->cols);
+    memset(s->nextseq, 0, s->rows * s->cols * SCREEN_SEQ);
+    memset(s->nextattr, 0, s->rows * s->cols);
+}
+
+// whether cell i holds the same character past ASCII in both frames, given that it starts with the same byte
+int screenSameSeq(struct screen *s, int i) {
+    return memcmp(&s->nextseq[i * SCREEN_SEQ], &s->shownseq[i * SCREEN_SEQ], SCREEN_SEQ) == 0;
+}
+
+// whether cell i is the same in both frames, and whether it is blank in the new one. the foreground color of a blank doesn't show.
+int screenSame(struct screen *s, int i) {
+    return s->next[i] == s->shown[i] && s->nextattr[i] == s->shownattr[i] && ((unsigned char) s->next[i] < 0x80 || screenSameSeq(s, i));
+}
+
+int screenBlank(struct screen *s, int i) {
+    return s->next[i] == ' ' && (s->nextattr[i] & ATTR_FLAGS) == 0;
+}
+
+// the number of decimal digits in n
+int screenDigits(int n) {
+    int d = 1;
+    while (n >= 10) {
+        n /= 10;
+        d++;
+    }
+    return d;
+}
+
+// formats a cursor position (CUP), leaving out the parameters that default to the first row and column
+int screenCup(char *buf, int y, int x) {
+    if (x == 0) return y == 0 ? sprintf(buf, "\x1b[H") : sprintf(buf, "\x1b[%dH", y + 1);
+    return sprintf(buf, "\x1b[%d;%dH", y + 1, x + 1);
+}
+
+int screenCupCost(int y, int x) {
+    if (x == 0) return y == 0 ? 3 : 3 + screenDigits(y + 1);
+    return 4 + screenDigits(y + 1) + screenDigits(x + 1);
+}
+
+// formats a move of n rows or columns in direction dir (A up, B down, C right, D left), leaving out a count of 1
+int screenStep(char *buf, int n, char dir) {
+    if (n == 1) return sprintf(buf, "\x1b[%c", dir);
+    return sprintf(buf, "\x1b[%d%c", n, dir);
+}
+
+int screenStepCost(int n) {
+    return n == 1 ? 3 : 3 + screenDigits(n);
+}
+
+// whether the cursor can cross row y from x0 to x1 by writing over the cells with what they already show: they have to be plain
+// characters in the current attributes, or blanks in the current flags
+int screenCanOverwrite(struct screen *s, int y, int x0, int x1) {
+    int i;
+    for (i = y * s->cols + x0; i < y * s->cols + x1; i++) {
+        unsigned char c = s->shown[i];
+        if (c < 0x20 || c >= 0x7f) return 0;
+        if (s->shownattr[i] != s->attr && !(c == ' ' && ((s->shownattr[i] ^ s->attr) & ATTR_FLAGS) == 0)) return 0;
+    }
+    return 1;
+}
+
+// ways of getting to a row or a column, for screenMoveTo()
+enum screenMove { MOVE_NONE, MOVE_CUP, MOVE_STEP, MOVE_REPEAT, MOVE_OVERWRITE };
+
+// moves the cursor the cheapest way there is, like curses' mvcur. the choices are an absolute position (CUP), or relative moves from
+// where the cursor is or from the start of its row after a carriage return: line feeds or CUD/CUU to get to the row, then backspaces,
+// CUF/CUB, or writing over the cells in between with what they already show to get to the column. relative moves need the cursor's row,
+// and moves that don't start with a carriage return its column. only the cost of each is worked out, and only the cheapest is formatted.
+void screenMoveTo(struct screen *s, struct frame *f, int y, int x) {
+    if (s->cy == y && s->cx == x) return;
+    int best = screenCupCost(y, x), bestcr = 0, rowmove = MOVE_CUP, colmove = MOVE_NONE, cr;
+
+    for (cr = 0; cr <= 1 && s->cy >= 0; cr++) {
+        int from = cr ? 0 : s->cx;
+        if (from < 0) continue;
+        int cost = cr, row = MOVE_NONE, col = MOVE_NONE, n;
+        // output processing is off, so a line feed only moves down. y is never past the bottom row, so it never scrolls.
+        if (y != s->cy) {
+            n = screenStepCost(y > s->cy ? y - s->cy : s->cy - y);
+            row = MOVE_STEP;
+            if (y > s->cy && y - s->cy <= n) {
+                n = y - s->cy;
+                row = MOVE_REPEAT;
+            }
+            cost += n;
+        }
+        if (x != from) {
+            n = screenStepCost(x > from ? x - from : from - x);
+            col = MOVE_STEP;
+            if (x < from && from - x <= n) {
+                n = from - x;
+                col = MOVE_REPEAT;
+            } else if (x > from && x - from < n && cost + x - from < best && screenCanOverwrite(s, y, from, x)) {
+                n = x - from;
+                col = MOVE_OVERWRITE;
+            }
+            cost += n;
+        }
+        if (cost < best) {
+            best = cost;
+            bestcr = cr;
+            rowmove = row;
+            colmove = col;
+        }
+    }
+
+    char buf[48];
+    int len = 0, from = bestcr ? 0 : s->cx;
+    if (rowmove == MOVE_CUP) {
+        len = screenCup(buf, y, x);
+    } else {
+        if (bestcr) buf[len++] = '\r';
+        if (rowmove == MOVE_STEP) len += screenStep(&buf[len], y > s->cy ? y - s->cy : s->cy - y, y > s->cy ? 'B' : 'A');
+        if (rowmove == MOVE_REPEAT) {
+            memset(&buf[len], '\n', y - s->cy);
+            len += y - s->cy;
+        }
+        if (colmove == MOVE_STEP) len += screenStep(&buf[len], x > from ? x - from : from - x, x > from ? 'C' : 'D');
+        if (colmove == MOVE_REPEAT) {
+            memset(&buf[len], '\b', from - x);
+            len += from - x;
+        }
+    }
+    if (len > 0) frameAddCopy(f, buf, len);
+    if (colmove == MOVE_OVERWRITE) frameAdd(f, &s->shown[y * s->cols + from], x - from);
+    s->cy = y;
+    s->cx = x;
+}
+
+// writes the SGR parameters that take the attributes from what they are to attr, each followed by a ';', and returns how many bytes that is
+int screenSgrParams(char *buf, unsigned char from, unsigned char attr) {
+    int len = 0;
+    if ((from ^ attr) & ATTR_INVERSE) len += sprintf(&buf[len], "%s;", attr & ATTR_INVERSE ? "7" : "27");
+    if ((from ^ attr) & ATTR_FG_MASK) {
+        if (attr & ATTR_FG_MASK) len += sprintf(&buf[len], "3%d;", ((attr & ATTR_FG_MASK) >> 4) - 1);
+        else len += sprintf(&buf[len], "39;");
+    }
+    return len;
+}
+
+// switches the terminal to attr by changing only what differs from the current attributes, or by resetting them all and setting attr's
+// from scratch when that comes out shorter, as it does when turning several off at once
+void screenSetAttr(struct screen *s, struct frame *f, unsigned char attr) {
+    if (s->attr == attr) return;
+    unsigned char from = s->attr;
+    s->attr = attr;
+    if (attr == 0) {
+        frameAdd(f, "\x1b[m", 3);
+        return;
+    }
+    char diff[32], reset[32];
+    int dlen = screenSgrParams(&diff[2], from, attr);
+    int rlen = 2 + screenSgrParams(&reset[4], 0, attr);
+    char *buf = diff;
+    if (rlen < dlen) {
+        buf = reset;
+        dlen = rlen;
+        memcpy(&reset[2], "0;", 2);
+    }
+    // the last parameter's ';' becomes the final 'm'
+    memcpy(buf, "\x1b[", 2);
+    buf[dlen + 1] = 'm';
+    frameAddCopy(f, buf, dlen + 2);
+}
+
+// the number of rows from top to bot - 1 that would already be right if the shown ones were scrolled by k
+int screenRowsMatching(struct screen *s, int top, int bot, int k) {
+    int y, n = 0;
+    for (y = top; y < bot; y++) {
+        if (y + k < top || y + k >= bot) continue;
+        int a = y * s->cols, b = (y + k) * s->cols;
+        if (memcmp(&s->next[a], &s->shown[b], s->cols) == 0 && memcmp(&s->nextattr[a], &s->shownattr[b], s->cols) == 0 &&
+            memcmp(&s->nextseq[a * SCREEN_SEQ], &s->shownseq[b * SCREEN_SEQ], s->cols * SCREEN_SEQ) == 0) {
+            n++;
+        }
+    }
+    return n;
+}
+
+// if the scroll hint is worth following, has the terminal scroll its rows and scrolls the shown grid to match, which leaves only the rows
+// scrolled into view to be drawn
+void screenScroll(struct screen *s, struct frame *f) {
+    int top = s->scrolltop, bot = s->scrollbot, k = s->scrollby;
+    s->scrollby = 0;
+    if (!s->canscroll || k == 0 || k >= bot - top || -k >= bot - top) return;
+    // the hint is only a guess at what moved, so it's checked against what is actually on the screen
+    if (screenRowsMatching(s, top, bot, k) <= screenRowsMatching(s, top, bot, 0)) return;
+
+    // the rows scrolled in are blanked with the current background, so that has to be the plain one
+    if (s->attr & ATTR_FLAGS) screenSetAttr(s, f, 0);
+    // the region is scrolled the way a vt100 does it, since that is all a DA1 answer promises: a line feed at its bottom margin moves it up
+    // a line, and a reverse index (RI) at its top margin moves it down. SU and SD would take fewer bytes, but a terminal that ignores them
+    // would leave the screen out of step with shown.
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dr\x1b[%d;1H", top + 1, bot, k > 0 ? bot : top + 1), i;
+    frameAddCopy(f, buf, len);
+    for (i = 0; i < (k > 0 ? k : -k); i++) frameAddCopy(f, k > 0 ? "\n" : "\x1bM", k > 0 ? 1 : 2);
+    frameAddCopy(f, "\x1b[r", 3);
+    // resetting the scroll region sends the cursor home
+    s->cy = s->cx = -1;
+
+    int n = bot - top - (k > 0 ? k : -k), from = k > 0 ? top + k : top, to = k > 0 ? top : top - k;
+    int blank = k > 0 ? top + n : top;
+    memmove(&s->shown[to * s->cols], &s->shown[from * s->cols], n * s->cols);
+    memmove(&s->shownseq[to * s->cols * SCREEN_SEQ], &s->shownseq[from * s->cols * SCREEN_SEQ], n * s->cols * SCREEN_SEQ);
+    memmove(&s->shownattr[to * s->cols], &s->shownattr[from * s->cols], n * s->cols);
+    memset(&s->shown[blank * s->cols], ' ', (bot - top - n) * s->cols);
+    memset(&s->shownseq[blank * s->cols * SCREEN_SEQ], 0, (bot - top - n) * s->cols * SCREEN_SEQ);
+    memset(&s->shownattr[blank * s->cols], 0, (bot - top - n) * s->cols);
+}
+
+// adds cells x to end - 1 of row y of the shown grid to the frame: ASCII straight from the grid, a longer character from its seq bytes, and
+// nothing for the right half of a wide one, which the character before it already covers
+void screenAddCells(struct screen *s, struct frame *f, int y, int x, int end) {
+    int row = y * s->cols, i;
+    while (x < end) {
+        for (i = x; i < end && (unsigned char) s->shown[row + i] < 0x80 && s->shown[row + i] != CELL_CONT; i++);
+        frameAdd(f, &s->shown[row + x], i - x);
+        if (i == end) break;
+        if (s->shown[row + i] != CELL_CONT) frameAdd(f, &s->shownseq[(row + i) * SCREEN_SEQ], utf8Len(s->shown[row + i]));
+        x = i + 1;
+    }
+}
+
+// writes cells x to end - 1 of row y from the shown grid, with the cursor at x. a run of one character can go out as the character and a
+// repeat (REP), and a run of blanks as an erase (ECH) and a move past it, when the terminal has those and that comes out shorter.
+void screenWrite(struct screen *s, struct frame *f, int y, int x, int end) {
+    int row = y * s->cols, wide = 0, j, i;
+    // where the cursor was left by an erase at the very end, which doesn't move it
+    int erased = -1;
+    // a run of equal attributes at a time. a space looks the same whatever the foreground color, so spaces go along with the run they are
+    // in rather than switching colors back and forth around every gap between words.
+    for (j = x; j < end;) {
+        unsigned char attr = s->shownattr[row + j];
+        if (s->shown[row + j] == ' ' && (attr & ATTR_FLAGS) == (s->attr & ATTR_FLAGS)) attr = s->attr;
+        int k = j;
+        while (k < end && (s->shownattr[row + k] == attr ||
+                           (s->shown[row + k] == ' ' && (s->shownattr[row + k] & ATTR_FLAGS) == (attr & ATTR_FLAGS)))) {
+            if ((unsigned char) s->shown[row + k] >= 0x80) wide = 1;
+            k++;
+        }
+        screenSetAttr(s, f, attr);
+
+        if (!s->canrepeat && !s->canerase) {
+            screenAddCells(s, f, y, j, k);
+            j = k;
+            continue;
+        }
+        // what isn't a long enough run goes out as it is, from plain on
+        int plain = j;
+        for (i = j; i < k;) {
+            char c = s->shown[row + i];
+            int m = 1;
+            while (i + m < k && s->shown[row + i + m] == c) m++;
+            if (m < 5 || (unsigned char) c >= 0x80) {
+                i += m;
+                continue;
+            }
+            char rep[16], ech[32];
+            int replen = sprintf(rep, "\x1b[%db", m - 1), echlen = 0;
+            if (!s->canrepeat) replen = INT_MAX / 2;
+            // erased cells take the current background, which is the plain one only when no flags are on
+            if (s->canerase && c == ' ' && (s->attr & ATTR_FLAGS) == 0) {
+                echlen = sprintf(ech, "\x1b[%dX", m);
+                if (i + m < end) echlen += screenStep(&ech[echlen], m, 'C');
+            }
+            if (echlen > 0 && echlen <= replen + 1 && echlen < m) {
+                screenAddCells(s, f, y, plain, i);
+                frameAddCopy(f, ech, echlen);
+                if (i + m == end) erased = i;
+                plain = i + m;
+            } else if (replen + 1 < m) {
+                screenAddCells(s, f, y, plain, i + 1);
+                frameAddCopy(f, rep, replen);
+                plain = i + m;
+            }
+            i += m;
+        }
+        screenAddCells(s, f, y, plain, k);
+        j = k;
+    }
+    // a terminal may not agree with wcwidth() on how wide a character past ASCII is, and after the last column it is waiting to wrap, so
+    // in both cases it's safest to forget where the cursor went
+    if (wide) s->cx = -1;
+    else if (erased >= 0) s->cx = erased;
+    else s->cx = end == s->cols ? -1 : end;
+}
+
+// adds to the frame whatever it takes to turn the frame on the terminal into the new one, which then becomes the frame on the terminal. the
+// characters written are pointed at where they sit in the grid rather than copied.
+void screenFlush(struct screen *s, struct frame *f) {
+    int y, x;
+
+    if (!s->valid) {
+        frameAdd(f, "\x1b[m\x1b[2J", 7);
+        memset(s->shown, ' ', s->rows * s->cols);
+        memset(s->shownseq, 0, s->rows * s->cols * SCREEN_SEQ);
+        memset(s->shownattr, 0, s->rows * s->cols);
+        s->attr = 0;
+        s->cy = s->cx = -1;
+        s->valid = 1;
+        s->scrollby = 0;
+    }
+    screenScroll(s, f);
+    memcpy(s->before, s->shown, s->rows * s->cols);
+    memcpy(s->beforeseq, s->shownseq, s->rows * s->cols * SCREEN_SEQ);
+    memcpy(s->beforeattr, s->shownattr, s->rows * s->cols);
+    frameMark(f);
+
+    for (y = 0; y < s->rows; y++) {
+        int row = y * s->cols;
+        // past tail the new row is blank, which a single erase to the end of the line takes care of
+        int tail = s->cols;
+        while (tail > 0 && screenBlank(s, row + tail - 1)) tail--;
+
+        x = 0;
+        while (x < s->cols) {
+            if (screenSame(s, row + x)) {
+                x++;
+                continue;
+            }
+            if (x >= tail) {
+                screenMoveTo(s, f, y, x);
+                if (s->attr & ATTR_FLAGS) screenSetAttr(s, f, 0);
+                frameAdd(f, "\x1b[K", 3);
+                memcpy(&s->shown[row + x], &s->next[row + x], s->cols - x);
+                memcpy(&s->shownseq[(row + x) * SCREEN_SEQ], &s->nextseq[(row + x) * SCREEN_SEQ], (s->cols - x) * SCREEN_SEQ);
+                memcpy(&s->shownattr[row + x], &s->nextattr[row + x], s->cols - x);
+                break;
+            }
+
+            // the span to write is the changed cells from x. the unchanged ones after it are left to the next cursor move, which writes
+            // over them when that is the cheapest way across. a character two columns wide is written whole, so the span takes in its
+            // right half even when that hasn't changed.
+            int end = x + 1;
+            while (end < tail && !screenSame(s, row + end)) end++;
+            while (end < s->cols && s->next[row + end] == CELL_CONT) end++;
+            memcpy(&s->shown[row + x], &s->next[row + x], end - x);
+            memcpy(&s->shownseq[(row + x) * SCREEN_SEQ], &s->nextseq[(row + x) * SCREEN_SEQ], (end - x) * SCREEN_SEQ);
+            memcpy(&s->shownattr[row + x], &s->nextattr[row + x], end - x);
+            screenMoveTo(s, f, y, x);
+            screenWrite(s, f, y, x, end);
+            x = end;
+        }
+        frameMark(f);
+    }
+}
+
+// cuts the frame being written short at the end of the first row that isn't all out yet, once a newer frame makes the rest of it not
+// worth waiting for. the rows left out go back to what the terminal still shows, for the next flush to compare against, and the terminal
+// is left in plain attributes and showing what it has, since the cursor moves and modes at the end of the frame don't go out either.
+void screenCut(struct screen *s, struct frame *f) {
+    int k = 0;
+    while (k < f->ncuts && f->cuts[k] < f->sent) k++;
+    // from the end of the last row there are only the cursor and the modes to go
+    if (k >= f->ncuts - 1) return;
+    frameCut(f, f->cuts[k]);
+    // cut k is where row k starts
+    memcpy(&s->shown[k * s->cols], &s->before[k * s->cols], (s->rows - k) * s->cols);
+    memcpy(&s->shownseq[k * s->cols * SCREEN_SEQ], &s->beforeseq[k * s->cols * SCREEN_SEQ], (s->rows - k) * s->cols * SCREEN_SEQ);
+    memcpy(&s->shownattr[k * s->cols], &s->beforeattr[k * s->cols], (s->rows - k) * s->cols);
+    frameAdd(f, "\x1b[m", 3);
+    if (s->sync) frameAdd(f, "\x1b[?2026l", 8);
+    s->attr = 0;
+    s->cy = s->cx = -1;
+    s->hidden = 1;
+}
+
+/*** line cache ***/
+
+// sizes the line cache for a screen of the given size, with room for several screens' worth of lines, and empties it
+void lcInit(struct lineCache *lc, int rows, int cols) {
+    int n = 1;
+    while (n < rows * 8 || n < LINE_CACHE_WAYS) n *= 2;
+    free(lc->slots);
+    free(lc->text);
+    free(lc->attr);
+    lc->nslots = n;
+    lc->cols = cols;
+    lc->slots = calloc(n, sizeof(struct lineCacheEntry));
+    lc->text = malloc((size_t) n * (cols > 0 ? cols : 1) * SCREEN_SEQ);
+    lc->attr = malloc((size_t) n * (cols > 0 ? cols : 1) * SCREEN_SEQ);
+    if (lc->slots == NULL || lc->text == NULL || lc->attr == NULL) die("malloc");
+    lc->gen = 1;
+}
+
+// notes an edit at position off
+void lcEdited(struct lineCache *lc, size_t off) {
+    lc->gen++;
+    lc->log[lc->gen % LINE_CACHE_LOG] = off;
+}
+
+// the first of the LINE_CACHE_WAYS slots a row can go in. the rows a wrapped line is drawn in differ only in coloff, so that goes into the
+// hash too, or they would all be competing for one set.
+struct lineCacheEntry *lcSet(struct lineCache *lc, size_t off, size_t coloff) {
+    size_t h = (off + coloff * 0x632BE59BD9B4E019ull) * (size_t) 0x9E3779B97F4A7C15ull;
+    return &lc->slots[((h >> 20) & (lc->nslots / LINE_CACHE_WAYS - 1)) * LINE_CACHE_WAYS];
+}
+
+char *lcText(struct lineCache *lc, struct lineCacheEntry *e) {
+    return &lc->text[(size_t) (e - lc->slots) * lc->cols * SCREEN_SEQ];
+}
+
+unsigned char *lcAttr(struct lineCache *lc, struct lineCacheEntry *e) {
+    return &lc->attr[(size_t) (e - lc->slots) * lc->cols * SCREEN_SEQ];
+}
+
+// the cached rendering of the line from off to end scrolled to coloff, or NULL if there isn't a good one
+struct lineCacheEntry *lcFind(struct lineCache *lc, size_t off, size_t end, size_t coloff) {
+    struct lineCacheEntry *e = lcSet(lc, off, coloff);
+    int i;
+    for (i = 0; i < LINE_CACHE_WAYS && !(e->gen != 0 && e->off == off && e->end == end && e->coloff == coloff); i++) e++;
+    if (i == LINE_CACHE_WAYS || lc->gen - e->gen >= LINE_CACHE_LOG) {
+        lc->misses++;
+        return NULL;
+    }
+    unsigned long g;
+    for (g = e->gen + 1; g <= lc->gen; g++) {
+        if (lc->log[g % LINE_CACHE_LOG] <= end) {
+            e->gen = 0;
+            lc->misses++;
+            return NULL;
+        }
+    }
+    e->gen = lc->gen;
+    e->used = ++lc->clock;
+    lc->hits++;
+    return e;
+}
+
+// the slot to render the line from off to end into, which is then good for the current generation. it takes the place of whichever line
+// in its set was used longest ago.
+struct lineCacheEntry *lcStore(struct lineCache *lc, size_t off, size_t end, size_t coloff) {
+    struct lineCacheEntry *set = lcSet(lc, off, coloff), *e = set;
+    int i;
+    for (i = 1; i < LINE_CACHE_WAYS; i++) {
+        if (set[i].used < e->used) e = &set[i];
+    }
+    e->used = ++lc->clock;
+    e->off = off;
+    e->end = end;
+    e->coloff = coloff;
+    e->gen = lc->gen;
+    e->len = 0;
+    return e;
+}
+
+/*** wrap layout ***/
+
+size_t wlRowsFor(unsigned width, int cols) {
+    if (width <= 1) return 1;
+    return (width - 1 + cols - 1) / cols;
+}
+
+size_t wlRows(struct wrapLayout *wl, size_t line) {
+    return wlRowsFor(wl->width[line], wl->cols);
+}
+
+// the rows of lines 0 to k - 1, for k no more than built
+size_t wlPrefix(struct wrapLayout *wl, size_t k) {
+    size_t sum = 0;
+    for (; k > 0; k &= k - 1) sum += wl->tree[k];
+    return sum;
+}
+
+// forgets the tree from line k on, to be worked out again
+void wlRewind(struct wrapLayout *wl, size_t k) {
+    if (k >= wl->built) return;
+    wl->built = k;
+    wl->total = wlPrefix(wl, k);
+}
+
+// adds the line at built to the tree
+void wlBuildNext(struct wrapLayout *wl) {
+    size_t i = ++wl->built;
+    wl->total += wlRows(wl, i - 1);
+    wl->tree[i] = wl->total - wlPrefix(wl, i - (i & -i));
+}
+
+// makes room for n lines
+void wlReserve(struct wrapLayout *wl, size_t n) {
+    if (n <= wl->cap) return;
+    size_t cap = wl->cap ? wl->cap : 1024;
+    while (cap < n) cap *= 2;
+    wl->width = realloc(wl->width, cap * sizeof(unsigned));
+    wl->tree = realloc(wl->tree, (cap + 1) * sizeof(size_t));
+    if (wl->width == NULL || wl->tree == NULL) die("realloc");
+    wl->cap = cap;
+}
+
+// keeps the layout to the lines that can be looked up, and to the screen width
+void wlSync(struct wrapLayout *wl, size_t lines, int cols) {
+    if (wl->cols != cols) {
+        wl->cols = cols;
+        wlRewind(wl, 0);
+    }
+    if (lines > wl->n) {
+        wlReserve(wl, lines);
+        memset(&wl->width[wl->n], 0, (lines - wl->n) * sizeof(unsigned));
+    }
+    wl->n = lines;
+    wlRewind(wl, lines);
+}
+
+void wlSetWidth(struct wrapLayout *wl, size_t line, size_t width) {
+    unsigned w = width < UINT_MAX - 1 ? width + 1 : UINT_MAX;
+    if (line >= wl->built) {
+        wl->width[line] = w;
+        return;
+    }
+    // a line already in the tree changes every entry covering it
+    size_t old = wlRows(wl, line), i;
+    wl->width[line] = w;
+    size_t rows = wlRows(wl, line);
+    for (i = line + 1; i <= wl->built; i += i & -i) wl->tree[i] += rows - old;
+    wl->total += rows - old;
+}
+
+// the line screen row row falls in, and the row within it. returns 0 if the tree doesn't reach that far yet.
+int wlFind(struct wrapLayout *wl, size_t row, size_t *line, size_t *sub) {
+    if (row >= wl->total) return 0;
+    size_t pos = 0, step = 1;
+    while (step * 2 <= wl->built) step *= 2;
+    for (; step > 0; step /= 2) {
+        if (pos + step <= wl->built && wl->tree[pos + step] <= row) {
+            pos += step;
+            row -= wl->tree[pos];
+        }
+    }
+    *line = pos;
+    *sub = row;
+    return 1;
+}
+
+// notes an edit to line that added or removed lines after it. its width is forgotten, and the lines after it move.
+void wlEdited(struct wrapLayout *wl, size_t line, size_t added, size_t removed) {
+    if (line >= wl->n) return;
+    // counted as one row until it is measured again
+    wlSetWidth(wl, line, 0);
+    wl->width[line] = 0;
+    if (added == 0 && removed == 0) return;
+    if (removed > wl->n - line - 1) removed = wl->n - line - 1;
+    wlReserve(wl, wl->n + added);
+    memmove(&wl->width[line + 1 + added], &wl->width[line + 1 + removed], (wl->n - line - 1 - removed) * sizeof(unsigned));
+    memset(&wl->width[line + 1], 0, added * sizeof(unsigned));
+    wl->n += added - removed;
+    wlRewind(wl, line + 1);
+}
+
+/*** column index ***/
+
+// the marks of the line starting at start, or NULL if it has none
+struct columnLine *ciFind(struct columnIndex *ci, size_t start) {
+    int i;
+    for (i = 0; i < COLUMN_INDEX_LINES; i++) {
+        struct columnLine *cl = &ci->lines[i];
+        if (cl->n > 0 && cl->start == start) {
+            cl->used = ++ci->clock;
+            return cl;
+        }
+    }
+    return NULL;
+}
+
+// the slot to mark the line starting at start in. it takes the place of whichever line was looked up longest ago, and keeps its memory.
+struct columnLine *ciStore(struct columnIndex *ci, size_t start) {
+    struct columnLine *cl = &ci->lines[0];
+    int i;
+    for (i = 1; i < COLUMN_INDEX_LINES; i++) {
+        if (ci->lines[i].used < cl->used) cl = &ci->lines[i];
+    }
+    cl->start = start;
+    cl->n = 0;
+    cl->used = ++ci->clock;
+    return cl;
+}
+
+void ciAdd(struct columnLine *cl, struct columnMark m) {
+    if (cl->n == cl->cap) {
+        cl->cap = cl->cap ? cl->cap * 2 : 64;
+        cl->marks = realloc(cl->marks, cl->cap * sizeof(struct columnMark));
+        if (cl->marks == NULL) die("realloc");
+    }
+    cl->marks[cl->n++] = m;
+}
+
+// the last mark at or before both byte cx and column rx, or NULL if there is none. marks go up in both.
+struct columnMark *ciSeek(struct columnLine *cl, size_t cx, size_t rx) {
+    size_t lo = 0, hi = cl->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cl->marks[mid].cx <= cx && cl->marks[mid].rx <= rx) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 ? &cl->marks[lo - 1] : NULL;
+}
+
+// notes an edit at off. the marks before it still hold, since what a mark says only depends on the bytes before it.
+void ciEdited(struct columnIndex *ci, size_t off) {
+    int i;
+    for (i = 0; i < COLUMN_INDEX_LINES; i++) {
+        struct columnLine *cl = &ci->lines[i];
+        if (off < cl->start) cl->n = 0;
+        while (cl->n > 0 && cl->start + cl->marks[cl->n - 1].cx > off) cl->n--;
+    }
+}
+
+// forgets every mark, for when what they say about highlighting no longer holds
+void ciClear(struct columnIndex *ci) {
+    int i;
+    for (i = 0; i < COLUMN_INDEX_LINES; i++) ci->lines[i].n = 0;
+}
+
+/*** syntax highlighting ***/
+
+// files with these extensions get their numbers and strings highlighted. they all have // comments, which are left alone.
+char *HL_extensions[] = {".c", ".h", ".cpp", ".hpp", ".cc", ".js", ".go", ".rs", ".java", NULL};
+
+#define HL_NUMBER ATTR_FG(1)
+#define HL_STRING ATTR_FG(5)
+
+int editorIsSeparator(int c) {
+    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+}
+
+void editorSelectSyntaxHighlight() {
+    E.syntax = 0;
+    if (E.filename == NULL) return;
+    char *ext = strrchr(E.filename, '.');
+    if (ext == NULL) return;
+    int i;
+    for (i = 0; HL_extensions[i]; i++) {
+        if (strcmp(ext, HL_extensions[i]) == 0) E.syntax = 1;
+    }
+    // lines rendered before are colored wrong now, and the highlighting kept with the column marks is wrong too
+    lcInit(&E.lines, E.screenrows, E.screencols);
+    ciClear(&E.columns);
+}
+
+// works out the attributes of the next n bytes of a line, carrying on from where the highlighter is in it, and leaves it after them. hl
+// can be NULL, to only keep track of where it is. a line is highlighted on its own, so a string that runs on past the end of a line stops
+// there.
+void editorHighlight(struct hlState *st, const char *chars, size_t n, unsigned char *hl) {
+    if (!E.syntax) {
+        if (hl != NULL) memset(hl, 0, n);
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+        char c = chars[i];
+        unsigned char h = 0;
+        int slash = st->slash;
+        st->slash = 0;
+
+        if (st->comment) {
+            // the rest of the line is a comment, which is left alone
+        } else if (st->quote) {
+            h = HL_STRING;
+            if (st->escaped) st->escaped = 0;
+            else if (c == '\\') st->escaped = 1;
+            else if (c == st->quote) st->quote = 0;
+            st->sep = 1;
+        } else if (c == '/' && slash) {
+            st->comment = 1;
+        } else if (c == '"' || c == '\'') {
+            st->quote = c;
+            h = HL_STRING;
+        } else if ((isdigit((unsigned char) c) && (st->sep || st->number)) || (c == '.' && st->number)) {
+            h = HL_NUMBER;
+            st->sep = 0;
+        } else {
+            st->sep = editorIsSeparator((unsigned char) c);
+            st->slash = c == '/';
+        }
+        st->number = h == HL_NUMBER;
+        if (hl != NULL) hl[i] = h;
+    }
+}
+
+/*** editor operations ***/
+
+// lines up to this one can be looked up exactly. past it the document hasn't been indexed yet.
+size_t editorKnownLines() {
+    return ptLineOf(&E.pt, E.pt.knownlen);
+}
+
+// lines up to this one are numbered exactly. while the view is anchored by estimate, that is as far as the index had got when the anchor
+// was placed, so line numbers keep meaning the same text as indexing goes on.
+size_t editorExactLines() {
+    if (E.anchored) return ptLineOf(&E.pt, E.anchorbase);
+    return editorKnownLines();
+}
+
+// the average line length seen so far, which is what estimates of the unindexed part go by
+size_t editorAverageLineLen() {
+    size_t lines = editorKnownLines();
+    if (lines == 0) return 80;
+    return E.pt.knownlen / lines + 1;
+}
+
+// the line count, estimated while indexing is still running
+size_t editorLineCount() {
+    if (E.pt.knownlen == E.pt.len) return ptLineCount(&E.pt);
+    return editorKnownLines() + (E.pt.len - E.pt.knownlen) / editorAverageLineLen() + 1;
+}
+
+// places an anchor for a line past the known region, guessing its offset from the average line length and then moving forward to the next real
+// line start, so the guess always lands somewhere the index doesn't cover yet.
+void editorEstimateAnchor(size_t line) {
+    size_t known = editorKnownLines();
+    size_t off = E.pt.knownlen + (line - known) * editorAverageLineLen();
+    if (off > E.pt.len) off = E.pt.len;
+
+    size_t nl = ptFindForward(&E.pt, off);
+    if (nl < E.pt.len) {
+        off = nl + 1;
+    } else {
+        // the guess overshot into the last line, so start at the beginning of that
+        off = ptFindBackward(&E.pt, E.pt.len) + 1;
+    }
+    E.anchored = 1;
+    E.anchorline = line;
+    E.anchoroff = off;
+    E.anchorbase = E.pt.knownlen;
+}
+
+// steps the anchor to the given line by scanning the text between them
+void editorMoveAnchor(size_t line) {
+    while (E.anchorline < line) {
+        size_t nl = ptFindForward(&E.pt, E.anchoroff);
+        if (nl == E.pt.len) break;
+        E.anchoroff = nl + 1;
+        E.anchorline++;
+    }
+    while (E.anchorline > line && E.anchoroff > 0) {
+        E.anchoroff = ptFindBackward(&E.pt, E.anchoroff - 1) + 1;
+        E.anchorline--;
+    }
+}
+
+size_t editorLineStart(size_t line) {
+    if (line <= editorExactLines()) return ptLineStart(&E.pt, line);
+
+    // out past the known region everything is relative to the anchor. a jump too far from it to scan is a fresh estimate instead, or,
+    // if the index has got there in the meantime, the exact line, which leaves the anchor behind.
+    if (!E.anchored || (line > E.anchorline ? line - E.anchorline : E.anchorline - line) > 10000) {
+        if (line <= editorKnownLines()) {
+            E.anchored = 0;
+            return ptLineStart(&E.pt, line);
+        }
+        editorEstimateAnchor(line);
+    }
+    editorMoveAnchor(line);
+    return E.anchoroff;
+}
+
+// the offset of the '\n' ending the line, or the document length for the last line, which has none. once the whole document is indexed
+// that is known without looking for it, which for a long last line would mean reading all of it.
+size_t editorLineEnd(size_t line) {
+    if (line + 1 <= editorExactLines()) return ptLineStart(&E.pt, line + 1) - 1;
+    if (!E.anchored && E.pt.knownlen == E.pt.len && line + 1 >= ptLineCount(&E.pt)) return E.pt.len;
+    return ptFindForward(&E.pt, editorLineStart(line));
+}
+
+size_t editorLineLen(size_t line) {
+    return editorLineEnd(line) - editorLineStart(line);
+}
+
+int editorIsLastLine(size_t line) {
+    return editorLineEnd(line) == E.pt.len;
+}
+
+// the cursor's byte position in the document
+size_t editorCursorOffset() {
+    return editorLineStart(E.cy) + E.cx;
+}
+
+// edits ahead of the anchor move it along with the text it points at
+void editorInsertText(size_t off, const char *s, size_t len) {
+    if (E.anchored && off < E.anchoroff) {
+        E.anchoroff += len;
+        E.anchorline += nlCount(s, len);
+        if (off <= E.anchorbase) E.anchorbase += len;
+    }
+    if (E.wrap && off <= E.pt.knownlen) wlEdited(&E.layout, ptLineOf(&E.pt, off), nlCount(s, len), 0);
+    ptInsert(&E.pt, off, s, len);
+    lcEdited(&E.lines, off);
+    ciEdited(&E.columns, off);
+}
+
+void editorDeleteText(size_t off, size_t len) {
+    if (E.anchored && off < E.anchoroff) {
+        if (off + len <= E.anchoroff) {
+            E.anchorline -= ptCountNewlines(&E.pt, off, len);
+            E.anchoroff -= len;
+        } else {
+            // the anchor's line start is being deleted, so it moves to the start of the line the deletion ends up on
+            E.anchorline -= ptCountNewlines(&E.pt, off, E.anchoroff - off);
+            E.anchoroff = ptFindBackward(&E.pt, off) + 1;
+        }
+        if (off + len <= E.anchorbase) {
+            E.anchorbase -= len;
+        } else if (off < E.anchorbase) {
+            E.anchorbase = off;
+        }
+    }
+    if (E.wrap && off <= E.pt.knownlen) wlEdited(&E.layout, ptLineOf(&E.pt, off), 0, ptCountNewlines(&E.pt, off, len));
+    ptDelete(&E.pt, off, len);
+    lcEdited(&E.lines, off);
+    ciEdited(&E.columns, off);
+}
+
+// the edit commands check this first, and refuse with a message in view mode
+int editorCanEdit() {
+    if (E.readonly) {
+        editorSetStatusMessage("Read-only view (-R)");
+        return 0;
+    }
+    return 1;
+}
+
+void editorInsertChar(int c) {
+    if (!editorCanEdit()) return;
+    char ch = c;
+    editorInsertText(editorCursorOffset(), &ch, 1);
+    E.cx++;
+}
+
+void editorInsertNewline() {
+    if (!editorCanEdit()) return;
+    editorInsertText(editorCursorOffset(), "\n", 1);
+    E.cy++;
+    E.cx = 0;
+}
+
+// deletes the character left of the cursor. at the start of a line that is the previous line's '\n', so the two lines join.
+void editorDelChar() {
+    if (!editorCanEdit()) return;
+    if (E.cx == 0 && E.cy == 0) return;
+
+    size_t off = editorCursorOffset(), len = 1;
+    if (E.cx > 0) {
+        len = editorCharLen(off - E.cx, editorLineEnd(E.cy), E.cx, 1);
+        E.cx -= len;
+    } else {
+        E.cy--;
+        E.cx = editorLineLen(E.cy);
+    }
+    editorDeleteText(off - len, len);
+}
+
+// deletes the character under the cursor, which at the end of a line is its '\n', and at the end of the document is nothing at all. the
+// cursor stays where it is.
+void editorDelCharRight() {
+    if (!editorCanEdit()) return;
+    size_t off = editorCursorOffset();
+    if (off == E.pt.len) return;
+    size_t len = editorCharLen(off - E.cx, editorLineEnd(E.cy), E.cx, 0);
+    editorDeleteText(off, len > 0 ? len : 1);
+}
+
+/*** columns ***/
+
+// how many columns the character that starts the n bytes at s takes up when drawn at column rx, and in len how many bytes long it is. a
+// tab reaches to the next tab stop, and a UTF-8 character takes as many columns as wcwidth() says, none for one that combines with the
+// character before it. anything else is a byte that is drawn as one column: ASCII as it is, and a control character, an invalid byte, or
+// the first byte of a character that can't be shown, as a '?', with the rest of its bytes after it.
+int editorCharWidth(const char *s, size_t n, size_t rx, int *len) {
+    *len = 1;
+    if (*s == '\t') return TAB_STOP - rx % TAB_STOP;
+    if ((unsigned char) *s < 0x80) return 1;
+    unsigned cp;
+    int bytes = utf8Decode(s, n, &cp), width = utf8Width(cp);
+    if (width < 0) return 1;
+    *len = bytes;
+    return width;
+}
+
+// how many bytes the character in the line from off to end takes up that starts at byte cx, or with back set, that ends there. moving the
+// cursor and deleting go a character at a time, the way editorCharWidth() splits the line up.
+int editorCharLen(size_t off, size_t end, size_t cx, int back) {
+    char buf[SCREEN_SEQ];
+    int len, i;
+    if (!back) {
+        size_t n = ptRead(&E.pt, off + cx, buf, end - off - cx < sizeof(buf) ? end - off - cx : sizeof(buf));
+        if (n == 0) return 0;
+        editorCharWidth(buf, n, 0, &len);
+        return len;
+    }
+    int n = cx < sizeof(buf) ? cx : sizeof(buf);
+    n = ptRead(&E.pt, off + cx - n, buf, n);
+    // the character is the one that starts at the last byte that isn't a continuation byte, if it reaches all the way to cx
+    for (i = n - 1; i > 0 && ((unsigned char) buf[i] & 0xc0) == 0x80; i--);
+    if (i >= 0 && i < n - 1) {
+        editorCharWidth(&buf[i], n - i, 0, &len);
+        if (len == n - i) return len;
+    }
+    return n > 0 ? 1 : 0;
+}
+
+// walks the line from off to end up to byte cx or column rx, whichever comes first, and returns the last place a character starts at on
+// the way: for a byte, where it is, and for a column, where the character drawn there starts. the walk starts from the nearest mark, and
+// on a long line it leaves marks behind it for the next one. the text is read a piece at a time, so walking a long line doesn't take any
+// more memory than a short one.
+struct columnMark editorColumnSeek(size_t off, size_t end, size_t cx, size_t rx) {
+    struct columnLine *cl = ciFind(&E.columns, off);
+    struct columnMark m = {.hl = {.sep = 1}}, *near;
+    if (cl != NULL && (near = ciSeek(cl, cx, rx)) != NULL) m = *near;
+    // the next mark goes COLUMN_MARK_STEP bytes past the last one. a line gets marks once it is read that far.
+    size_t next = cl != NULL ? cl->marks[cl->n - 1].cx + COLUMN_MARK_STEP : COLUMN_MARK_STEP;
+    if (cx > end - off) cx = end - off;
+
+    char buf[4096];
+    int stop = 0;
+    while (m.cx < cx && !stop) {
+        size_t n = ptRead(&E.pt, off + m.cx, buf, cx - m.cx < sizeof(buf) ? cx - m.cx : sizeof(buf)), j = 0, from = 0;
+        if (n == 0) break;
+        // a character cut short at the end of a full piece is left for the next one
+        if (n == sizeof(buf)) n = utf8Whole(buf, n);
+        // m.rx is kept up with character by character, and m.cx and the highlighting only at marks and at the end of each piece
+        while (j < n) {
+            // a run of characters one column wide goes by without the checks below, as far as the column being looked for or the next
+            // mark at most
+            size_t run = n - j, k;
+            if (run > rx - m.rx) run = rx - m.rx;
+            if (run > next - (m.cx + j - from)) run = next - (m.cx + j - from);
+            for (k = j; k < j + run && buf[k] != '\t' && (unsigned char) buf[k] < 0x80; k++);
+            m.rx += k - j;
+            j = k;
+            if (j == n) break;
+
+            int len, width = editorCharWidth(&buf[j], n - j, m.rx, &len);
+            if (m.rx + width > rx) {
+                stop = 1;
+                break;
+            }
+            m.rx += width;
+            j += len;
+            if (m.cx + j - from >= next) {
+                editorHighlight(&m.hl, &buf[from], j - from, NULL);
+                m.cx += j - from;
+                from = j;
+                if (cl == NULL) cl = ciStore(&E.columns, off);
+                ciAdd(cl, m);
+                next = m.cx + COLUMN_MARK_STEP;
+            }
+        }
+        editorHighlight(&m.hl, &buf[from], j - from, NULL);
+        m.cx += j - from;
+    }
+    return m;
+}
+
+// the byte in a line that is drawn at column rx
+size_t editorRxToCx(size_t line, size_t rx) {
+    return editorColumnSeek(editorLineStart(line), editorLineEnd(line), (size_t) -1, rx).cx;
+}
+
+/*** soft wrap ***/
+
+// the lines the wrap layout covers: those that can be looked up exactly, and the last one once it is known where the document ends
+size_t editorWrapLines() {
+    if (E.pt.knownlen == E.pt.len) return ptLineCount(&E.pt);
+    return editorExactLines();
+}
+
+// the width of a line drawn in full
+size_t editorMeasureLine(size_t line) {
+    return editorColumnSeek(editorLineStart(line), editorLineEnd(line), (size_t) -1, (size_t) -1).rx;
+}
+
+// the screen rows a line takes up, measuring it if that hasn't been done yet
+size_t editorLineRows(size_t line) {
+    struct wrapLayout *wl = &E.layout;
+    if (line < wl->n) {
+        if (wl->width[line] == 0) wlSetWidth(wl, line, editorMeasureLine(line));
+        return wlRows(wl, line);
+    }
+    size_t width = editorMeasureLine(line);
+    return wlRowsFor(width < UINT_MAX - 1 ? width + 1 : UINT_MAX, E.screencols);
+}
+
+// the screen row a line starts on, counting from the top of the document. past what the layout has summed up, lines count as one row each.
+size_t editorWrapRowOf(size_t line) {
+    struct wrapLayout *wl = &E.layout;
+    if (line <= wl->built) return wlPrefix(wl, line);
+    return wl->total + (line - wl->built);
+}
+
+// moves row sub of line up by k screen rows, stopping at the top of the document
+void editorWrapBack(size_t *line, size_t *sub, size_t k) {
+    struct wrapLayout *wl = &E.layout;
+    size_t row = *line <= wl->built ? wlPrefix(wl, *line) + *sub : 0;
+    if (*line <= wl->built && wlFind(wl, row > k ? row - k : 0, line, sub)) return;
+    while (k > 0) {
+        if (*sub >= k) {
+            *sub -= k;
+            return;
+        }
+        k -= *sub;
+        if (*line == 0) {
+            *sub = 0;
+            return;
+        }
+        k--;
+        (*line)--;
+        *sub = editorLineRows(*line) - 1;
+    }
+}
+
+// and down by k, stopping at the last row of the document
+void editorWrapForward(size_t *line, size_t *sub, size_t k) {
+    struct wrapLayout *wl = &E.layout;
+    if (*line < wl->built && wlFind(wl, wlPrefix(wl, *line) + *sub + k, line, sub)) return;
+    while (k > 0) {
+        size_t rows = editorLineRows(*line);
+        if (*sub + k < rows) {
+            *sub += k;
+            return;
+        }
+        if (editorIsLastLine(*line)) {
+            *sub = rows - 1;
+            return;
+        }
+        k -= rows - *sub;
+        (*line)++;
+        *sub = 0;
+    }
+}
+
+// how many screen rows down row tosub of toline is from row sub of line, which comes before it. the count stops at limit.
+size_t editorWrapDistance(size_t line, size_t sub, size_t toline, size_t tosub, size_t limit) {
+    struct wrapLayout *wl = &E.layout;
+    size_t d;
+    if (toline <= wl->built) {
+        d = wlPrefix(wl, toline) + tosub - wlPrefix(wl, line) - sub;
+        return d < limit ? d : limit;
+    }
+    // every line is at least a row, so one too far down to fit on the screen can't be
+    if (toline - line >= limit) return limit;
+    d = 0;
+    while (line < toline) {
+        d += editorLineRows(line) - sub;
+        if (d >= limit) return limit;
+        sub = 0;
+        line++;
+    }
+    d += tosub - sub;
+    return d < limit ? d : limit;
+}
+
+// whether the layout has lines left to measure or sum up
+int editorRelayoutPending() {
+    struct wrapLayout *wl = &E.layout;
+    return E.wrap && (wl->built < wl->n || wl->n != editorWrapLines() || wl->cols != E.screencols);
+}
+
+// works on the layout for a few milliseconds, in between keys. this is the only place lines that are never drawn get measured.
+void editorRelayout() {
+    struct wrapLayout *wl = &E.layout;
+    if (!E.wrap) return;
+    wlSync(wl, editorWrapLines(), E.screencols);
+    double start = editorNow();
+    while (wl->built < wl->n) {
+        if (wl->width[wl->built] == 0) wlSetWidth(wl, wl->built, editorMeasureLine(wl->built));
+        wlBuildNext(wl);
+        if ((wl->built & 1023) == 0 && editorNow() - start > 0.005) break;
+    }
+}
+
+void editorToggleWrap() {
+    E.wrap = !E.wrap;
+    E.coloff = 0;
+    E.rowsub = 0;
+    // the widths weren't kept up with while wrapping was off
+    E.layout.n = E.layout.built = E.layout.total = 0;
+    editorSetStatusMessage("Soft wrap %s", E.wrap ? "on" : "off");
+}
+
+/*** output ***/
+
+// with soft wrap the window only ever moves up and down, by screen rows, to keep the cursor's row in view
+void editorScrollWrapped() {
+    size_t cols = E.screencols;
+    wlSync(&E.layout, editorWrapLines(), cols);
+    E.coloff = 0;
+    size_t sub = E.rx / cols, rows = editorLineRows(E.cy);
+    if (sub >= rows) sub = rows - 1;
+    // an edit can leave the top of the screen past the end of its line
+    rows = editorLineRows(E.rowoff);
+    if (E.rowsub >= rows) E.rowsub = rows - 1;
+
+    if (E.cy < E.rowoff || (E.cy == E.rowoff && sub < E.rowsub)) {
+        E.rowoff = E.cy;
+        E.rowsub = sub;
+    }
+    size_t y = editorWrapDistance(E.rowoff, E.rowsub, E.cy, sub, E.screenrows);
+    if (y >= (size_t) E.screenrows) {
+        E.rowoff = E.cy;
+        E.rowsub = sub;
+        editorWrapBack(&E.rowoff, &E.rowsub, E.screenrows - 1);
+        y = editorWrapDistance(E.rowoff, E.rowsub, E.cy, sub, E.screenrows);
+    }
+    E.wrapcy = y;
+    E.wrapcx = E.rx - sub * cols < cols ? E.rx - sub * cols : cols - 1;
+}
+
+void editorScroll() {
+    E.rx = 0;
+    if (E.cx > 0) {
+        // the walk stops at the cursor, so the rest of the line doesn't matter
+        size_t off = editorLineStart(E.cy);
+        E.rx = editorColumnSeek(off, off + E.cx, E.cx, (size_t) -1).rx;
+    }
+    if (E.wrap) {
+        editorScrollWrapped();
+        return;
+    }
+
+    if (E.cy < E.rowoff) {
+        E.rowoff = E.cy;
+    }
+    if (E.cy >= E.rowoff + E.screenrows) {
+        E.rowoff = E.cy - E.screenrows + 1;
+    }
+    if (E.rx < E.coloff) {
+        E.coloff = E.rx;
+    }
+    if (E.rx >= E.coloff + E.screencols) {
+        E.coloff = E.rx - E.screencols + 1;
+    }
+}
+
+// makes room in a snapshot for a text area of the given size. this only allocates when the screen has grown.
+void snapshotReserve(struct snapshot *snap, int rows, int cols) {
+    snap->rows = rows;
+    snap->cols = cols;
+    if (rows * cols <= snap->cap && rows <= snap->cap) return;
+    snap->cap = rows * cols > rows ? rows * cols : rows;
+    free(snap->text);
+    free(snap->attr);
+    free(snap->len);
+    snap->text = malloc(snap->cap * SCREEN_SEQ);
+    snap->attr = malloc(snap->cap * SCREEN_SEQ);
+    snap->len = malloc(snap->cap * sizeof(int));
+    if (snap->text == NULL || snap->attr == NULL || snap->len == NULL) die("malloc");
+}
+
+// renders rows of the line from off to end into the snapshot, from row y on: rows rows of cols columns each, the first of them starting at
+// column coloff of the line. without soft wrap that is just the one row.
+void editorDrawLine(struct snapshot *snap, int y, size_t off, size_t end, size_t coloff, int rows) {
+    size_t cols = snap->cols;
+    struct lineCacheEntry *ce;
+    int r;
+    for (r = 0; r < rows && (ce = lcFind(&E.lines, off, end, coloff + r * cols)) != NULL; r++) {
+        memcpy(&snap->text[(y + r) * cols * SCREEN_SEQ], lcText(&E.lines, ce), ce->len);
+        memcpy(&snap->attr[(y + r) * cols * SCREEN_SEQ], lcAttr(&E.lines, ce), ce->len);
+        snap->len[y + r] = ce->len;
+    }
+    if (r == rows) return;
+
+    // the rows that weren't cached are rendered in one go, from the character drawn at the first of their columns. the column index finds
+    // that without reading the line from its start, along with the highlighting state there, and the text from there on is read a piece
+    // at a time, until the rows are full. so however long the line is, drawing it reads little more than what is drawn.
+    size_t first = coloff + r * cols, max = coloff + rows * cols;
+    struct columnMark m = editorColumnSeek(off, end, (size_t) -1, first);
+
+    // expand tabs and blank out control characters and invalid bytes, keeping only the columns that fall inside the rows being drawn. each
+    // row goes in the line cache as it is finished.
+    ce = lcStore(&E.lines, off, end, first);
+    char *render = lcText(&E.lines, ce);
+    unsigned char *attr = lcAttr(&E.lines, ce);
+    char chars[4096];
+    unsigned char hl[sizeof(chars)];
+    size_t at = off + m.cx, rx = m.rx, rowend = first + cols;
+    int len = 0;
+    while (at < end && rx < max) {
+        size_t n = ptRead(&E.pt, at, chars, end - at < sizeof(chars) ? end - at : sizeof(chars)), j;
+        if (n == 0) break;
+        if (n == sizeof(chars)) n = utf8Whole(chars, n);
+        editorHighlight(&m.hl, chars, n, hl);
+        for (j = 0; j < n && rx < max;) {
+            char c = chars[j];
+            int clen, width = editorCharWidth(&chars[j], n - j, rx, &clen), col;
+            if (c == '\t') {
+                c = ' ';
+            } else if (iscntrl((unsigned char) c) || (unsigned char) c >= 0x80) {
+                c = '?';
+            }
+            for (col = 0; col < width && rx < max; col++) {
+                if (rx == rowend) {
+                    ce->len = len;
+                    memcpy(&snap->text[(y + r) * cols * SCREEN_SEQ], render, len);
+                    memcpy(&snap->attr[(y + r) * cols * SCREEN_SEQ], attr, len);
+                    snap->len[y + r] = len;
+                    r++;
+                    ce = lcStore(&E.lines, off, end, rowend);
+                    render = lcText(&E.lines, ce);
+                    attr = lcAttr(&E.lines, ce);
+                    len = 0;
+                    rowend += cols;
+                }
+                // a character of more than one byte goes in whole at its first column, and the screen works out the columns it takes.
+                // one that the edge of a row cuts in two is drawn as blanks.
+                size_t start = rx - col;
+                if (rx >= first && clen > 1 && start >= rowend - cols && start + width <= rowend) {
+                    if (col == 0) {
+                        memset(&attr[len], hl[j], clen);
+                        memcpy(&render[len], &chars[j], clen);
+                        len += clen;
+                    }
+                } else if (rx >= first) {
+                    attr[len] = hl[j];
+                    render[len++] = clen > 1 ? ' ' : c;
+                }
+                rx++;
+            }
+            j += clen;
+        }
+        at += n;
+    }
+    // the last row with anything in it, and then any left empty
+    for (; r < rows; r++) {
+        ce->len = len;
+        memcpy(&snap->text[(y + r) * cols * SCREEN_SEQ], render, len);
+        memcpy(&snap->attr[(y + r) * cols * SCREEN_SEQ], attr, len);
+        snap->len[y + r] = len;
+        if (r + 1 < rows) ce = lcStore(&E.lines, off, end, coloff + (r + 1) * cols);
+        len = 0;
+    }
+}
+
+// renders the lines in view into the snapshot
+void editorDrawRows(struct snapshot *snap) {
+    int y = 0;
+    size_t line = E.rowoff, sub = E.wrap ? E.rowsub : 0;
+    // the line count may only be an estimate, so the end of the document is spotted by a line running up to the document length instead
+    int pastend = 0;
+    while (y < E.screenrows) {
+        if (pastend) {
+            snap->len[y++] = -1;
+            continue;
+        }
+        size_t off = editorLineStart(line);
+        size_t end = editorLineEnd(line);
+        if (end == E.pt.len) pastend = 1;
+        if (!E.wrap) {
+            editorDrawLine(snap, y++, off, end, E.coloff, 1);
+        } else {
+            // as many of the line's rows as fit, from sub on
+            size_t rows = editorLineRows(line);
+            int n = rows > sub ? rows - sub : 1;
+            if (n > E.screenrows - y) n = E.screenrows - y;
+            editorDrawLine(snap, y, off, end, sub * E.screencols, n);
+            y += n;
+            sub = 0;
+        }
+        line++;
+    }
+}
+
+// the status bar is drawn in inverted colors (7m) and shows the file, the cursor line and, while the file is still being indexed, how far along
+// that is. line numbers that are only estimates get a '~' in front.
+void editorDrawStatusBar(struct snapshot *snap) {
+    int exact = E.pt.knownlen == E.pt.len;
+    snprintf(snap->status, sizeof(snap->status), "%.20s%s - %s%zu lines", E.filename ? E.filename : "[No Name]",
+             E.readonly ? " [view]" : "", exact ? "" : "~", editorLineCount());
+    if (E.streamfd != -1) {
+        snprintf(snap->rstatus, sizeof(snap->rstatus), "reading %.1f MB | %zu", E.pt.len / 1048576.0, E.cy + 1);
+    } else if (E.idx.running) {
+        snprintf(snap->rstatus, sizeof(snap->rstatus), "indexing %d%% | %s%zu", (int) (E.pt.origfrontier * 100.0 / E.pt.origlen),
+                 E.cy > editorExactLines() ? "~" : "", E.cy + 1);
+    } else {
+        snprintf(snap->rstatus, sizeof(snap->rstatus), "%zu/%zu", E.cy + 1, editorLineCount());
+    }
+}
+
+// the message bar shows the last status message for five seconds
+void editorDrawMessageBar(struct snapshot *snap) {
+    snap->msg[0] = '\0';
+    if (time(NULL) - E.statusmsg_time < 5) snprintf(snap->msg, sizeof(snap->msg), "%s", E.statusmsg);
+}
+
+// copies what the next frame shows out of the editor. this is the input thread's part of drawing.
+void editorSnapshot(struct snapshot *snap) {
+    ptFrameReset(&E.pt);
+    editorScroll();
+
+    snapshotReserve(snap, E.screenrows, E.screencols);
+    snap->bars = E.screenbars;
+    editorDrawRows(snap);
+    editorDrawStatusBar(snap);
+    editorDrawMessageBar(snap);
+    snap->rowoff = E.rowoff;
+    snap->cy = E.cy - E.rowoff;
+    snap->cx = E.rx - E.coloff;
+    if (E.wrap) {
+        // the scroll hint goes by screen rows
+        snap->rowoff = editorWrapRowOf(E.rowoff) + E.rowsub;
+        snap->cy = E.wrapcy;
+        snap->cx = E.wrapcx;
+    }
+    snap->canscroll = E.termscroll;
+    snap->sync = E.termsync;
+    snap->resizes = E.resizes;
+    snap->erase = E.termerase;
+    snap->repeat = E.termrepeat;
+}
+
+// whether the terminal is too slow to take every frame at full detail
+int editorRenderSlow(struct editorRenderer *r) {
+    return r->rate != 0 && r->wbytes / r->rate > RENDER_SLOW;
+}
+
+// draws a snapshot on the screen and puts together in E.frame what has to be written to the terminal to show it. this is the render
+// thread's part of drawing.
+void editorDrawSnapshot(struct snapshot *snap) {
+    struct screen *s = &E.screen;
+    int y;
+
+    // the window changed size. the grids keep their memory, but what the terminal shows after a resize differs between terminals, so
+    // the frame is drawn in full. that goes even when the window ended up the size it started at, since many terminals reflow or clear
+    // the screen while it is being dragged.
+    if (snap->rows + snap->bars != s->rows || snap->cols != s->cols || snap->resizes != E.render.drawnresizes) {
+        screenResize(s, snap->rows + snap->bars, snap->cols);
+        E.render.drawnrowoff = snap->rowoff;
+        E.render.drawnresizes = snap->resizes;
+    }
+    s->canscroll = snap->canscroll;
+    s->sync = snap->sync;
+    s->canerase = snap->erase;
+    s->canrepeat = snap->repeat;
+    // when the view has moved by a few lines, the terminal can move the rows that stay in view itself
+    size_t drawn = E.render.drawnrowoff;
+    if (snap->rowoff != drawn) {
+        s->scrolltop = 0;
+        s->scrollbot = snap->rows;
+        if (snap->rowoff > drawn && snap->rowoff - drawn < (size_t) snap->rows) s->scrollby = snap->rowoff - drawn;
+        if (snap->rowoff < drawn && drawn - snap->rowoff < (size_t) snap->rows) s->scrollby = -(int) (drawn - snap->rowoff);
+        E.render.drawnrowoff = snap->rowoff;
+    }
+
+    screenClear(s);
+    for (y = 0; y < snap->rows; y++) {
+        if (snap->len[y] == -1) screenPut(s, y, 0, "~", 1, 0);
+        else screenPutAttrs(s, y, 0, &snap->text[y * snap->cols * SCREEN_SEQ], &snap->attr[y * snap->cols * SCREEN_SEQ], snap->len[y]);
+    }
+    if (snap->bars >= 1) {
+        int len = strlen(snap->status), rlen = strlen(snap->rstatus);
+        screenFill(s, snap->rows, 0, snap->cols, ' ', ATTR_INVERSE);
+        screenPut(s, snap->rows, 0, snap->status, len, ATTR_INVERSE);
+        // the position goes against the right edge, if there is room left for it
+        if (len + rlen <= snap->cols) screenPut(s, snap->rows, snap->cols - rlen, snap->rstatus, rlen, ATTR_INVERSE);
+    }
+    if (snap->bars >= 2) screenPut(s, snap->rows + 1, 0, snap->msg, strlen(snap->msg), 0);
+
+    // a slow terminal gets the text first. while it is changing, the status and message rows stay as they are, and they catch up in a
+    // frame of their own once it settles.
+    int text = snap->rows * snap->cols, bars = snap->bars * snap->cols;
+    E.render.deferred = 0;
+    if (editorRenderSlow(&E.render) && s->valid && bars > 0 &&
+        (memcmp(s->next, s->shown, text) != 0 || memcmp(s->nextattr, s->shownattr, text) != 0 ||
+         memcmp(s->nextseq, s->shownseq, text * SCREEN_SEQ) != 0) &&
+        (memcmp(&s->next[text], &s->shown[text], bars) != 0 ||
+         memcmp(&s->nextattr[text], &s->shownattr[text], bars) != 0 ||
+         memcmp(&s->nextseq[text * SCREEN_SEQ], &s->shownseq[text * SCREEN_SEQ], bars * SCREEN_SEQ) != 0)) {
+        memcpy(&s->next[text], &s->shown[text], bars);
+        memcpy(&s->nextseq[text * SCREEN_SEQ], &s->shownseq[text * SCREEN_SEQ], bars * SCREEN_SEQ);
+        memcpy(&s->nextattr[text], &s->shownattr[text], bars);
+        E.render.deferred = 1;
+    }
+
+    // only the cells that changed are written. the cursor is hidden while that happens, so it doesn't flicker about the screen, but when
+    // nothing changed there is no need to hide it. a terminal that does synchronized output is also told where the frame begins and ends,
+    // so it shows all of it at once rather than whatever has arrived when it next paints.
+    struct frame *f = &E.frame;
+    // a few pieces a row to start with. a frame that needs more grows the list, and it stays grown for the next.
+    frameReset(f, s->rows * 8);
+    if (s->sync) frameAdd(f, "\x1b[?2026h", 8);
+    frameAdd(f, "\x1b[?25l", 6);
+    size_t header = f->len;
+    screenFlush(s, f);
+    // a frame cut short left the cursor hidden, which the next one has to show again even when it has nothing else to do
+    int changed = f->len > header || s->hidden;
+    s->hidden = 0;
+    if (!changed) f->n = f->len = f->ncuts = 0;
+
+    // after drawing, we move the cursor to where it sits in the document, relative to the scrolled window
+    screenMoveTo(s, f, snap->cy, snap->cx);
+    if (changed) frameAdd(f, "\x1b[?25h", 6);
+    if (changed && s->sync) frameAdd(f, "\x1b[?2026l", 8);
+}
+
+// both halves of drawing on one thread, for the benchmarks
+void editorComposeFrame(struct snapshot *snap) {
+    editorSnapshot(snap);
+    editorDrawSnapshot(snap);
+}
+
+// writes out the frame drawn last. while the terminal is behind, this waits for it to take more and for a newer snapshot at once, and a
+// newer one cuts the frame short at the next row, so that a terminal on a congested link goes from the frame it has started on straight to
+// the newest, and is never sent the ones in between. how fast the terminal takes the frame when it is behind goes into the measure of its
+// throughput. returns whether it was behind at all.
+int editorRenderWrite(struct editorRenderer *r) {
+    struct frame *f = &E.frame;
+    int cut = 0, waited = 0, stopping = 0;
+    // the bytes of the frame out when the terminal last caught up
+    size_t from = 0;
+    double now = editorNow();
+    if (r->rate != 0) r->queued -= r->rate * (now - r->lastwrite);
+    else if (now - r->lastwrite >= RENDER_IDLE) r->queued = 0;
+    if (r->queued <= 0) {
+        r->queued = 0;
+        r->caughtup = now;
+        r->caughtupsent = r->sent;
+    }
+    while (!frameSend(f, r->fd)) {
+        struct pollfd fds[2] = {
+            {r->fd, POLLOUT, 0},
+            {r->wake[0], POLLIN, 0},
+        };
+        // once the thread is to stop, the terminal only gets a little while longer
+        int timeout = -1;
+        if (stopping) {
+            now = editorNow();
+            if (now >= r->stopby) break;
+            timeout = (int) ((r->stopby - now) * 1000) + 1;
+        }
+        if (poll(fds, stopping ? 1 : 2, timeout) == -1 && errno != EINTR) break;
+        if (fds[0].revents & POLLOUT) {
+            now = editorNow();
+            if (now > r->caughtup) {
+                double rate = (r->sent + f->sent - r->caughtupsent) / (now - r->caughtup);
+                r->rate = r->rate == 0 ? rate : r->rate + RENDER_EWMA * (rate - r->rate);
+            }
+            r->caughtup = now;
+            r->caughtupsent = r->sent + f->sent;
+            r->queued = 0;
+            from = f->sent;
+            waited = 1;
+        }
+        if (!stopping && (fds[1].revents & POLLIN)) {
+            char buf[64];
+            while (read(r->wake[0], buf, sizeof(buf)) > 0);
+            pthread_mutex_lock(&r->lock);
+            int newer = r->pending != NULL;
+            stopping = r->stop;
+            pthread_mutex_unlock(&r->lock);
+            if (!cut && (newer || stopping)) {
+                cut = 1;
+                screenCut(&E.screen, f);
+            }
+        }
+    }
+    r->sent += f->sent;
+    r->queued += f->sent - from;
+    r->lastwrite = editorNow();
+    if (f->len > 0) r->wbytes += RENDER_EWMA * (f->len - r->wbytes);
+    // a terminal that has taken well over what it should have at the rate measured has got faster
+    if (!waited && r->rate != 0 && r->sent - r->caughtupsent > r->rate * (r->lastwrite - r->caughtup) + RENDER_FAST_SLACK) r->rate = 0;
+    return waited;
+}
+
+// on a slow terminal, holds off the next frame until the terminal should be nearly through the ones before, so that keys coming in
+// meanwhile make one frame rather than several queued up in the buffers on the way to the terminal. a frame the terminal made the editor
+// wait for has been held off already, and a fast terminal is never held up.
+void editorRenderPace(struct editorRenderer *r, int waited) {
+    if (waited || !editorRenderSlow(r)) return;
+    double pace = RENDER_PACE * (r->queued - r->wbytes) / r->rate, now;
+    if (pace <= 0) return;
+    double until = editorNow() + (pace < RENDER_MAX_PACE ? pace : RENDER_MAX_PACE);
+    while ((now = editorNow()) < until) {
+        struct pollfd fd = {r->wake[0], POLLIN, 0};
+        if (poll(&fd, 1, (int) ((until - now) * 1000) + 1) > 0) {
+            char buf[64];
+            while (read(r->wake[0], buf, sizeof(buf)) > 0);
+        }
+        pthread_mutex_lock(&r->lock);
+        int stop = r->stop;
+        pthread_mutex_unlock(&r->lock);
+        if (stop) return;
+    }
+}
+
+// a slow terminal only ever holds up this thread. the input thread goes on taking keys and publishing snapshots, and however many it
+// publishes while a frame is being written, only the newest is drawn next.
+void *editorRenderThread(void *arg) {
+    struct editorRenderer *r = arg;
+
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (r->pending == NULL && !r->stop) pthread_cond_wait(&r->cond, &r->lock);
+        if (r->stop) break;
+        r->drawing = r->pending;
+        r->pending = NULL;
+        pthread_mutex_unlock(&r->lock);
+
+        editorDrawSnapshot(r->drawing);
+        editorRenderPace(r, editorRenderWrite(r));
+
+        pthread_mutex_lock(&r->lock);
+        // the status and message rows left out have to be drawn once the text stops changing, even if nothing else comes along
+        if (r->deferred && r->pending == NULL) r->pending = r->drawing;
+        r->drawing = NULL;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+void editorRenderStart() {
+    struct editorRenderer *r = &E.render;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pipe(r->wake) == -1) die("pipe");
+    fcntl(r->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(r->wake[1], F_SETFL, O_NONBLOCK);
+    // the terminal is opened again for writing, rather than stdout being made non-blocking, because stdout usually shares its open file
+    // with stdin, and the keys are read with blocking reads that wait a moment for the rest of an escape sequence
+    char *tty = ttyname(STDOUT_FILENO);
+    r->fd = tty != NULL ? open(tty, O_WRONLY | O_NOCTTY | O_NONBLOCK) : -1;
+    if (r->fd == -1) r->fd = STDOUT_FILENO;
+    if (pthread_create(&r->thread, NULL, editorRenderThread, r) != 0) die("pthread_create");
+    r->running = 1;
+}
+
+// lets the frame being written get to the end of a row and drops any still pending, so that nothing is written to the terminal after this
+// returns. a terminal that doesn't take the rest of the row within RENDER_STOP_WAIT has the frame dropped where it is. on the render
+// thread itself, as when it dies, there is nothing to wait for.
+void editorRenderStop() {
+    struct editorRenderer *r = &E.render;
+    if (!r->running || pthread_equal(pthread_self(), r->thread)) return;
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    r->stopby = editorNow() + RENDER_STOP_WAIT;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    write(r->wake[1], "", 1);
+    pthread_join(r->thread, NULL);
+    r->running = 0;
+}
+
+void editorRefreshScreen() {
+    struct editorRenderer *r = &E.render;
+    struct snapshot *snap = NULL;
+    int i;
+
+    // the snapshot to fill is one the render thread has no hold on. filling it happens outside the lock, since the render thread only
+    // ever takes the pending one.
+    pthread_mutex_lock(&r->lock);
+    for (i = 0; i < 3; i++) {
+        if (&r->snaps[i] != r->pending && &r->snaps[i] != r->drawing) snap = &r->snaps[i];
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    editorSnapshot(snap);
+
+    pthread_mutex_lock(&r->lock);
+    r->pending = snap;
+    int busy = r->drawing != NULL;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    // the render thread may be waiting on the terminal
+    if (busy) write(r->wake[1], "", 1);
+
+    editorTrimMemory();
+}
+
+// takes a terminal of rows by cols. the bottom two rows are taken by the status bar and the message bar, and the text gets what is left.
+// the text always keeps a row, so a terminal of two rows goes without the message bar and one of a single row without either.
+void editorSetSize(int rows, int cols) {
+    int bars = rows > 2 ? 2 : rows > 1 ? 1 : 0, text = rows - bars > 1 ? rows - bars : 1;
+    if (text == E.screenrows && bars == E.screenbars && cols == E.screencols) return;
+    E.screenrows = text;
+    E.screenbars = bars;
+    E.screencols = cols;
+    lcInit(&E.lines, text, cols);
+}
+
+// takes the terminal's new size, and has the next frame drawn in full, even at the size it was. the grids are resized by the render thread
+// when it gets a snapshot of the new size.
+void editorResize() {
+    struct winsize ws;
+    E.winchfirst = E.winchlast = 0;
+    // only the easy way: asking the terminal where its corner is would mix the answer in with the keys
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) return;
+    E.resizes++;
+    editorSetSize(ws.ws_row, ws.ws_col);
+    editorRefreshScreen();
+}
+
+void editorSetStatusMessage(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
+    va_end(ap);
+    E.statusmsg_time = time(NULL);
+}
+
+/*** input ***/
+
+// shows prompt in the message bar, with %s standing for what has been typed so far, and returns the answer once enter is pressed. escape
+// cancels and returns NULL. the caller frees the answer.
+char *editorPrompt(char *prompt) {
+    size_t bufsize = 128;
+    char *buf = malloc(bufsize);
+    if (buf == NULL) die("malloc");
+
+    size_t buflen = 0;
+    buf[0] = '\0';
+
+    while (1) {
+        editorSetStatusMessage(prompt, buf);
+        editorRefreshScreen();
+
+        int c = editorReadKey();
+        if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
+            if (buflen != 0) buf[--buflen] = '\0';
+        } else if (c == '\x1b') {
+            editorSetStatusMessage("");
+            free(buf);
+            return NULL;
+        } else if (c == '\r') {
+            if (buflen != 0) {
+                editorSetStatusMessage("");
+                return buf;
+            }
+        } else if (c >= 0 && c < 128 && !iscntrl(c)) {
+            if (buflen == bufsize - 1) {
+                bufsize *= 2;
+                buf = realloc(buf, bufsize);
+                if (buf == NULL) die("realloc");
+            }
+            buf[buflen++] = c;
+            buf[buflen] = '\0';
+        }
+    }
+}
+
+// jumps to a line. if it lies past what has been indexed, the jump lands on an estimate and the line number is corrected once indexing gets there.
+void editorGotoLine() {
+    char *answer = editorPrompt("Go to line: %s (ESC to cancel)");
+    if (answer == NULL) return;
+
+    long long line = atoll(answer);
+    free(answer);
+    if (line < 1) line = 1;
+
+    E.cy = line - 1;
+    if (E.pt.knownlen == E.pt.len && E.cy >= ptLineCount(&E.pt)) E.cy = ptLineCount(&E.pt) - 1;
+    E.cx = 0;
+    // put the line in the middle of the window
+    E.rowoff = E.cy > (size_t) E.screenrows / 2 ? E.cy - E.screenrows / 2 : 0;
+    if (E.wrap) {
+        E.rowoff = E.cy;
+        E.rowsub = 0;
+        editorWrapBack(&E.rowoff, &E.rowsub, E.screenrows / 2);
+    }
+}
+
+void editorMoveCursor(int key) {
+    switch (key) {
+        case ARROW_LEFT:
+            if (E.cx > 0) {
+                E.cx -= editorCharLen(editorLineStart(E.cy), editorLineEnd(E.cy), E.cx, 1);
+            } else if (E.cy > 0) {
+                E.cy--;
+                E.cx = editorLineLen(E.cy);
+            }
+            break;
+        case ARROW_RIGHT:
+            if (E.cx < editorLineLen(E.cy)) {
+                E.cx += editorCharLen(editorLineStart(E.cy), editorLineEnd(E.cy), E.cx, 0);
+            } else if (!editorIsLastLine(E.cy)) {
+                E.cy++;
+                E.cx = 0;
+            }
+            break;
+        case ARROW_UP:
+            if (E.cy > 0) E.cy--;
+            break;
+        case ARROW_DOWN:
+            if (!editorIsLastLine(E.cy)) E.cy++;
+            break;
+    }
+
+    // moving between lines can leave the cursor past the end of a shorter line, so snap it back
+    size_t linelen = editorLineLen(E.cy);
+    if (E.cx > linelen) E.cx = linelen;
+}
+
+void editorProcessKeypress() {
+    int c = editorReadKey();
+    switch (c) {
+        case '\r':
+            editorInsertNewline();
+            break;
+
+        case CTRL_KEY('q'):
+            editorClearOnExit();
+            exit(0);
+            break;
+
+        case HOME_KEY:
+            E.cx = 0;
+            break;
+
+        case END_KEY:
+            E.cx = editorLineLen(E.cy);
+            break;
+
+        case BACKSPACE:
+        case CTRL_KEY('h'):
+            editorDelChar();
+            break;
+
+        case DEL_KEY:
+            editorDelCharRight();
+            break;
+
+        case PAGE_UP:
+        case PAGE_DOWN:
+            // in the middle of a burst of keys the window hasn't been scrolled to the cursor yet, and paging goes by where it is
+            editorScroll();
+            if (E.wrap) {
+                // the same by screen rows: to the top of the window and a screen above it, or a screen below the bottom
+                size_t line = E.rowoff, sub = E.rowsub;
+                if (c == PAGE_UP) editorWrapBack(&line, &sub, E.screenrows);
+                else editorWrapForward(&line, &sub, 2 * E.screenrows - 1);
+                E.cy = line;
+                E.cx = editorRxToCx(line, sub * E.screencols);
+                break;
+            }
+            {
+                // first go to the top or bottom edge of the window, then a whole screen past it
+                int times = E.screenrows;
+                if (c == PAGE_UP) {
+                    E.cy = E.rowoff;
+                } else {
+                    times += E.rowoff + E.screenrows - 1 - E.cy;
+                }
+                while (times--) editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+            }
+            break;
+
+        case ARROW_UP:
+        case ARROW_DOWN:
+        case ARROW_LEFT:
+        case ARROW_RIGHT:
+            editorMoveCursor(c);
+            break;
+
+        case CTRL_KEY('g'):
+            editorGotoLine();
+            break;
+
+        case CTRL_KEY('w'):
+            editorToggleWrap();
+            break;
+
+        case CTRL_KEY('l'):
+        case '\x1b':
+        case TERMINAL_REPLY:
+            break;
+
+        default:
+            editorInsertChar(c);
+            break;
+    }
+}
+/*** memory budget ***/
+
+// once the mapped text read since the last trim adds up to half the budget, everything but the screen and an eighth of the budget around it is
+// handed back. the other half of the budget is what the add buffer may take up on the heap before it spills to disk.
+void editorTrimMemory() {
+    if (E.budget == 0) return;
+    if (ptTouched(&E.pt) > E.budget / 2) ptTrim(&E.pt, E.budget / 8);
+}
+
+// parses a size like "512M" or "16G"
+size_t editorParseSize(const char *s) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    switch (toupper((unsigned char) *end)) {
+        case 'T': n <<= 10; /* fall through */
+        case 'G': n <<= 10; /* fall through */
+        case 'M': n <<= 10; /* fall through */
+        case 'K': n <<= 10; end++; break;
+    }
+    if (end == s || *end != '\0') return 0;
+    return n;
+}
+
+/*** file i/o ***/
+
+// reads from a pipe or other unseekable source. nothing is mapped; the text lands in the add buffer as it arrives, and since the add buffer's
+// newlines are indexed on the way in, the line index grows with it.
+void editorOpenStream(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) die("fcntl");
+    E.streamfd = fd;
+}
+
+// drains whatever the stream has ready onto the end of the document. it stops after a few megabytes so a fast producer can't keep keystrokes
+// waiting; poll() will report the stream as readable again straight away.
+void editorStreamRead() {
+    static char buf[65536];
+    size_t budget = 4 << 20;
+
+    while (budget > 0) {
+        ssize_t n = read(E.streamfd, buf, sizeof(buf));
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EINTR) return;
+            die("read");
+        }
+        if (n == 0) {
+            close(E.streamfd);
+            E.streamfd = -1;
+            editorSetStatusMessage("%zu bytes read", E.pt.len);
+            return;
+        }
+        editorInsertText(E.pt.len, buf, n);
+        budget -= (size_t) n < budget ? (size_t) n : budget;
+    }
+}
+
+// whether the document would come from a terminal: stdin for "-", or a terminal device named directly. keys come from the terminal, so
+// reading the document from it too would take keystrokes and the terminal's replies in as text, and end the session at the first moment
+// nothing was typed.
+int editorIsTerminal(const char *filename) {
+    if (strcmp(filename, "-") == 0) return isatty(STDIN_FILENO);
+    struct stat st;
+    if (stat(filename, &st) == -1 || !S_ISCHR(st.st_mode)) return 0;
+    int fd = open(filename, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd == -1) return 0;
+    int tty = isatty(fd);
+    close(fd);
+    return tty;
+}
+
+// maps the file into memory and hands the mapping to the piece table as its original buffer. nothing is read here: the kernel faults pages in
+// as rendering touches them, so opening a huge file costs the same as opening a tiny one. the mapping is private and read-only, and edits never
+// write to it, they go to the add buffer instead. "-" and anything that isn't a regular file, like a fifo, are streamed instead.
+void editorOpen(char *filename) {
+    free(E.filename);
+
+    if (strcmp(filename, "-") == 0) {
+        E.filename = strdup("[stdin]");
+        editorOpenStream(STDIN_FILENO);
+        return;
+    }
+    E.filename = strdup(filename);
+    editorSelectSyntaxHighlight();
+    // without -d, edits spill next to the file, which is on a disk that can take them
+    if (E.spilldir == NULL) {
+        char *slash = strrchr(E.filename, '/');
+        int len = slash == NULL ? 0 : slash - E.filename;
+        if (slash == NULL) E.pt.spilldir = ".";
+        else if (len == 0) E.pt.spilldir = "/";
+        // a directory too long to keep is left out, and the scratch file goes in /var/tmp
+        else if (snprintf(E.filedir, sizeof(E.filedir), "%.*s", len, E.filename) < (int) sizeof(E.filedir)) E.pt.spilldir = E.filedir;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) die("open");
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) die("fstat");
+    if (!S_ISREG(st.st_mode)) {
+        editorOpenStream(fd);
+        return;
+    }
+
+    const char *orig = NULL;
+    size_t len = st.st_size;
+    // mmap refuses zero-length mappings, and an empty file has nothing to map anyway
+    if (len > 0) {
+        orig = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (orig == MAP_FAILED) die("mmap");
+    }
+    // the mapping keeps its own reference to the file, so the descriptor can go
+    close(fd);
+
+    // only the lines the first screen needs are indexed before returning. the rest are found in the background.
+    // when only viewing, the file's newlines are indexed sparsely: a billion-line file then needs megabytes of index instead of gigabytes.
+    // editing needs every line start at hand, so they're kept packed instead, at about a byte per line rather than eight.
+    nlIndexInit(&E.pt.orignl, E.readonly ? NL_SPARSE : NL_ELIAS_FANO, orig, len);
+    ptInit(&E.pt, orig, len, 0);
+    editorIndexStart();
+}
+
+/*** benchmarks ***/
+
+// the benchmarks are left out of the editor itself. build them with
+//     cc -O2 -DED_BENCH ed.c -o ed-bench
+// and run e.g. "./ed-bench --bench scan". "--bench frames" is a check rather than a timing: it plays the frames drawing produces to a model
+// terminal, and exits with 1 if the terminal ever ends up showing something other than it should. "--bench small" checks the same on
+// terminals too small for the status bars and a row of text.
+#ifdef ED_BENCH
+
+double benchNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// fills a buffer with log-like lines of 0 to 159 bytes, using a fixed seed so every run scans the same text
+char *benchMakeLog(size_t len) {
+    char *buf = malloc(len);
+    if (buf == NULL) die("malloc");
+    unsigned seed = 12345;
+    size_t i = 0;
+    while (i < len) {
+        seed = seed * 1103515245 + 12345;
+        size_t linelen = (seed >> 16) % 160;
+        size_t j;
+        for (j = 0; j < linelen && i < len; j++, i++) buf[i] = 'a' + (i + j) % 26;
+        if (i < len) buf[i++] = '\n';
+    }
+    return buf;
+}
+
+// compares the scalar and vector newline scanners, both counting and collecting, on 256 MB of synthetic log
+int benchScan() {
+    size_t len = (size_t) 256 << 20;
+    char *buf = benchMakeLog(len);
+    struct {
+        const char *name;
+        size_t (*count)(const char *, size_t);
+        void (*collect)(const char *, size_t, size_t, struct offsetVec *);
+    } scanners[] = {
+        {"scalar", nlCountScalar, nlCollectScalar},
+#ifdef ED_SIMD_X86
+        {"sse2", nlCountSSE2, nlCollectSSE2},
+        {"avx2", nlCountAVX2, nlCollectAVX2},
+#endif
+    };
+    int i, nscanners = sizeof(scanners) / sizeof(scanners[0]);
+    struct offsetVec out = {NULL, 0, 0};
+
+    nlInit();
+    printf("runtime dispatch picks: %s\n", nlScannerName);
+    for (i = 0; i < nscanners; i++) {
+#ifdef ED_SIMD_X86
+        if (scanners[i].count == nlCountAVX2 && !__builtin_cpu_supports("avx2")) continue;
+#endif
+        double t0 = benchNow();
+        size_t n = scanners[i].count(buf, len);
+        double t1 = benchNow();
+        out.n = 0;
+        scanners[i].collect(buf, len, 0, &out);
+        double t2 = benchNow();
+        printf("%-8s count: %8.2f GB/s   collect: %8.2f GB/s   (%zu newlines, %zu collected)\n", scanners[i].name,
+               len / (t1 - t0) / 1e9, len / (t2 - t1) / 1e9, n, out.n);
+    }
+    ovFree(&out);
+    free(buf);
+    return 0;
+}
+
+// compares the plain offset array with the elias-fano index on 1 GB of synthetic log: memory per line, build time, and lookup times
+int benchIndex() {
+    size_t len = (size_t) 1 << 30;
+    char *buf = benchMakeLog(len);
+    struct nlIndex ix[2];
+    const char *names[2] = {"dense", "elias-fano"};
+    int kinds[2] = {NL_DENSE, NL_ELIAS_FANO};
+    int i, lookups = 1000000;
+
+    nlInit();
+    memset(ix, 0, sizeof(ix));
+    for (i = 0; i < 2; i++) {
+        nlIndexInit(&ix[i], kinds[i], buf, len);
+        double t0 = benchNow();
+        // fed in indexer-sized chunks, the way the background thread builds it
+        size_t off;
+        for (off = 0; off < len; off += INDEX_CHUNK) {
+            nlIndexCollect(&ix[i], buf + off, len - off < INDEX_CHUNK ? len - off : INDEX_CHUNK, off);
+        }
+        double t1 = benchNow();
+
+        unsigned seed = 1;
+        size_t j, sum = 0;
+        for (j = 0; j < (size_t) lookups; j++) {
+            seed = seed * 1103515245 + 12345;
+            sum += nlIndexSelect(&ix[i], ((size_t) seed * 2654435761u) % ix[i].n);
+        }
+        double t2 = benchNow();
+        for (j = 0; j < (size_t) lookups; j++) {
+            seed = seed * 1103515245 + 12345;
+            sum += nlIndexRank(&ix[i], ((size_t) seed * 2654435761u) % len);
+        }
+        double t3 = benchNow();
+        // a screenful of consecutive lines, many times over, which is what drawing does
+        for (j = 0; j < (size_t) lookups; j++) sum += nlIndexSelect(&ix[i], (j / 100 * 7919 + j % 100) % ix[i].n);
+        double t4 = benchNow();
+
+        printf("%-10s %zu lines  %6.2f bits/line  build %6.0f ms  select %6.1f ns  rank %6.1f ns  consecutive select %6.1f ns  (%zu)\n",
+               names[i], ix[i].n, nlIndexBytes(&ix[i]) * 8.0 / ix[i].n, (t1 - t0) * 1e3, (t2 - t1) * 1e9 / lookups,
+               (t3 - t2) * 1e9 / lookups, (t4 - t3) * 1e9 / lookups, sum % 10);
+    }
+    for (i = 0; i < 2; i++) nlIndexFree(&ix[i]);
+    free(buf);
+    return 0;
+}
+
+int benchIndexChunk(void *arg, const struct offsetVec *found, struct nlIndex *packed, size_t start, size_t end) {
+    (void) start;
+    nlIndexAppendPacked(arg, found->v, found->n, end, packed);
+    return 0;
+}
+
+// builds the file's line index the way the editor does, at 1 to 32 scanning threads, on 1 GB of synthetic log
+int benchParallel() {
+    size_t len = (size_t) 1 << 30;
+    char *buf = benchMakeLog(len);
+    int threads[] = {1, 2, 4, 8, 16, 32};
+    int i;
+    struct nlIndex ix;
+
+    nlInit();
+    memset(&ix, 0, sizeof(ix));
+    printf("%ld cores online\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for (i = 0; i < (int) (sizeof(threads) / sizeof(threads[0])); i++) {
+        nlIndexInit(&ix, NL_ELIAS_FANO, buf, len);
+        double t0 = benchNow();
+        nlScanParallel(buf, 0, len, threads[i], NL_ELIAS_FANO, 0, benchIndexChunk, &ix);
+        double t1 = benchNow();
+        printf("%2d threads: %7.2f GB/s  (%zu lines)\n", threads[i], len / (t1 - t0) / 1e9, ix.n);
+    }
+    nlIndexFree(&ix);
+    free(buf);
+    return 0;
+}
+
+// sets the editor up on a terminal of the given size, showing the len bytes at buf, without touching the real terminal
+void benchEditorText(int rows, int cols, char *buf, size_t len) {
+    nlInit();
+    memset(&E.pt, 0, sizeof(E.pt));
+    E.pt.addfd = -1;
+    ptTouchReset(&E.pt);
+    nlIndexInit(&E.pt.orignl, NL_DENSE, buf, len);
+    nlIndexCollect(&E.pt.orignl, buf, len, 0);
+    ptInit(&E.pt, buf, len, len);
+    editorSetSize(rows, cols);
+    screenInit(&E.screen, E.screenrows + E.screenbars, cols);
+    // the text is new, so nothing cached for the last text goes for it even at the same size
+    lcInit(&E.lines, E.screenrows, cols);
+    E.streamfd = -1;
+}
+
+// the same with len bytes of synthetic log
+void benchEditor(int rows, int cols, size_t len) {
+    benchEditorText(rows, cols, benchMakeLog(len), len);
+}
+
+// times drawing the rows of a 300x100 terminal into the cell grid, and whole frames from drawing to output bytes, scrolling one line per
+// frame so there is always something to redraw, and checks that the buffers drawing uses stop growing
+int benchDraw() {
+    int frames = 20000, i;
+    benchEditor(100, 300, (size_t) 64 << 20);
+
+    static struct snapshot snap;
+    // a couple of frames first, so the buffers have grown to what drawing needs
+    for (i = 0; i < 2; i++) editorComposeFrame(&snap);
+    struct iovec *iov = E.frame.iov;
+    char **esc = E.frame.esc;
+    int iovcap = E.frame.cap, nesc = E.frame.nesc;
+
+    double t0 = benchNow();
+    for (i = 0; i < frames; i++) {
+        E.rowoff = i;
+        editorDrawRows(&snap);
+    }
+    double t1 = benchNow();
+    size_t bytes = 0;
+    for (i = 0; i < frames; i++) {
+        E.cy = E.rowoff = i;
+        editorComposeFrame(&snap);
+        bytes += E.frame.len;
+    }
+    double t2 = benchNow();
+    // back and forth over the same few screens, which the line cache should make nearly free
+    E.lines.hits = E.lines.misses = 0;
+    for (i = 0; i < frames; i++) {
+        E.rowoff = 1000 + (i % 200 < 100 ? i % 100 : 200 - i % 200);
+        editorDrawRows(&snap);
+    }
+    double t3 = benchNow();
+    double hit = E.lines.hits * 100.0 / (E.lines.hits + E.lines.misses);
+    // the same again with every line missing the cache, as though each frame came after an edit too far back for the cache to remember,
+    // which is what drawing costs without it
+    for (i = 0; i < frames; i++) {
+        E.rowoff = 1000 + (i % 200 < 100 ? i % 100 : 200 - i % 200);
+        E.lines.gen += LINE_CACHE_LOG;
+        editorDrawRows(&snap);
+    }
+    double t4 = benchNow();
+    E.screen.valid = 0;
+    editorComposeFrame(&snap);
+
+    printf("editorDrawRows: %7.1f us/frame, %7.1f us/frame scrolling back and forth (%.0f%% of lines cached), %7.1f us/frame uncached\n",
+           (t1 - t0) * 1e6 / frames, (t3 - t2) * 1e6 / frames, hit, (t4 - t3) * 1e6 / frames);
+    printf("whole frame:    %7.1f us/frame, %zu bytes/frame scrolling, %zu bytes redrawing everything\n", (t2 - t1) * 1e6 / frames,
+           bytes / frames, E.frame.len);
+    printf("buffers grew after warming up: %s\n",
+           iov != E.frame.iov || iovcap != E.frame.cap || esc != E.frame.esc || nesc != E.frame.nesc ? "yes" : "no");
+    return 0;
+}
+
+// times laying out a document for soft wrap from scratch, then at another width, when the widths are already known, and after a line is
+// added near the top. then checks the tree against the rows counted line by line.
+int benchWrap() {
+    benchEditor(50, 80, (size_t) 256 << 20);
+    struct wrapLayout *wl = &E.layout;
+    E.wrap = 1;
+    double t[4];
+    int i;
+    for (i = 0; i < 3; i++) {
+        if (i == 1) E.screencols = 120;
+        if (i == 2) editorInsertText(editorLineStart(10), "\n", 1);
+        t[i] = benchNow();
+        while (editorRelayoutPending()) editorRelayout();
+    }
+    t[3] = benchNow();
+    printf("%zu lines: %.1f ms from scratch, %.1f ms at a new width, %.1f ms after a new line at the top\n", wl->n, (t[1] - t[0]) * 1e3,
+           (t[2] - t[1]) * 1e3, (t[3] - t[2]) * 1e3);
+
+    size_t line, row = 0, bad = 0, sub, k;
+    for (line = 0; line < wl->n; line++) {
+        if (wlPrefix(wl, line) != row) bad++;
+        row += editorLineRows(line);
+    }
+    double t4 = benchNow();
+    for (k = 0; k < 1000000; k++) {
+        if (!wlFind(wl, k * 7919 % row, &line, &sub) || sub >= wlRows(wl, line)) bad++;
+    }
+    double t5 = benchNow();
+    printf("%zu rows, %zu wrong, %.0f ns to find the line of a row\n", row, bad, (t5 - t4) * 1e9 / 1000000);
+    return 0;
+}
+
+// times going to the end of a single 256 MB line, typing there, and going back to its start and then to its end again, with a frame after
+// each, and checks the cursor's column against the width of the line worked out straight from the text
+int benchLongLine() {
+    size_t len = (size_t) 256 << 20, rx = 0, i;
+    char *buf = benchMakeLog(len);
+    for (i = 0; i < len; i++) {
+        if (buf[i] == '\n') buf[i] = '\t';
+        rx += buf[i] == '\t' ? TAB_STOP - rx % TAB_STOP : 1;
+    }
+    benchEditorText(50, 80, buf, len);
+
+    static struct snapshot snap;
+    int keys = 1000, bad = 0;
+    double t[5];
+    t[0] = benchNow();
+    E.cx = editorLineLen(0);
+    editorComposeFrame(&snap);
+    if (E.rx != rx) bad++;
+    t[1] = benchNow();
+    for (i = 0; i < (size_t) keys; i++) {
+        editorInsertChar('x');
+        editorComposeFrame(&snap);
+    }
+    if (E.rx != rx + keys) bad++;
+    t[2] = benchNow();
+    E.cx = 0;
+    editorComposeFrame(&snap);
+    t[3] = benchNow();
+    E.cx = editorLineLen(0);
+    editorComposeFrame(&snap);
+    if (E.rx != rx + keys) bad++;
+    t[4] = benchNow();
+    printf("to the end %.1f ms, typing there %.1f us/key, to the start %.1f ms, to the end again %.1f ms, %d wrong\n", (t[1] - t[0]) * 1e3,
+           (t[2] - t[1]) * 1e6 / keys, (t[3] - t[2]) * 1e3, (t[4] - t[3]) * 1e3, bad);
+    return bad != 0;
+}
+
+// a terminal as far as the frames the editor writes go: the characters its cells show and their attributes, the cursor, the attributes it
+// draws with and the scroll region. it only knows the controls the screen code uses, and anything else it is sent counts as a mistake.
+// seq holds an escape sequence that hasn't all come in yet, since a frame cut short can stop in the middle of one, and utf8 a character
+// that hasn't.
+struct benchTerm {
+    int rows, cols;
+    unsigned *cell;
+    unsigned char *attr;
+    int y, x, wrapnext;
+    int top, bot;
+    unsigned char cur;
+    unsigned last;
+    char seq[32];
+    int nseq;
+    char utf8[4];
+    int nutf8;
+    int unknown;
+};
+
+// what a cell holds for the right half of a character two columns wide
+#define BT_RIGHT ((unsigned) -2)
+
+// a terminal of the given size showing fill everywhere, which is what a resize leaves as far as the editor may assume
+void btInit(struct benchTerm *t, int rows, int cols, char fill) {
+    int i;
+    free(t->cell);
+    free(t->attr);
+    t->cell = malloc(rows * cols * sizeof(unsigned));
+    t->attr = malloc(rows * cols);
+    if (t->cell == NULL || t->attr == NULL) die("malloc");
+    for (i = 0; i < rows * cols; i++) t->cell[i] = fill;
+    memset(t->attr, 0, rows * cols);
+    t->rows = rows;
+    t->cols = cols;
+    t->y = t->x = t->wrapnext = 0;
+    t->top = 0;
+    t->bot = rows - 1;
+    t->cur = 0;
+    t->last = ' ';
+    t->nseq = t->nutf8 = 0;
+}
+
+// once cell i is written over or erased, the other half of a wide character it was half of is left showing a blank, the way xterm does it
+void btSplit(struct benchTerm *t, int i) {
+    int x = i % t->cols;
+    if (t->cell[i] == BT_RIGHT && x > 0) t->cell[i - 1] = ' ';
+    if (x + 1 < t->cols && t->cell[i + 1] == BT_RIGHT) t->cell[i + 1] = ' ';
+}
+
+// blanks n cells from i the way an erase does, with the current background
+void btErase(struct benchTerm *t, int i, int n) {
+    int k;
+    btSplit(t, i);
+    btSplit(t, i + n - 1);
+    for (k = i; k < i + n; k++) t->cell[k] = ' ';
+    memset(&t->attr[i], t->cur & ATTR_FLAGS, n);
+}
+
+// moves the scroll region up a row, or down one
+void btScroll(struct benchTerm *t, int up) {
+    int c = t->cols, n = t->bot - t->top;
+    int from = up ? t->top + 1 : t->top, to = up ? t->top : t->top + 1;
+    memmove(&t->cell[to * c], &t->cell[from * c], n * c * sizeof(unsigned));
+    memmove(&t->attr[to * c], &t->attr[from * c], n * c);
+    btErase(t, (up ? t->bot : t->top) * c, c);
+}
+
+void btLineFeed(struct benchTerm *t) {
+    if (t->y == t->bot) btScroll(t, 1);
+    else if (t->y < t->rows - 1) t->y++;
+}
+
+// a character w columns wide goes at the cursor. one that reaches the last column leaves the cursor there until the next character,
+// which wraps first. the screen code never writes a wide character where only one column is left, which would wrap early.
+void btPut(struct benchTerm *t, unsigned c, int w) {
+    if (t->wrapnext) {
+        t->x = 0;
+        btLineFeed(t);
+    }
+    t->wrapnext = 0;
+    if (t->x + w > t->cols) {
+        t->unknown++;
+        return;
+    }
+    int i = t->y * t->cols + t->x;
+    btSplit(t, i);
+    if (w == 2) btSplit(t, i + 1);
+    t->cell[i] = c;
+    t->attr[i] = t->cur;
+    if (w == 2) {
+        t->cell[i + 1] = BT_RIGHT;
+        t->attr[i + 1] = t->cur;
+    }
+    t->last = c;
+    if (t->x + w == t->cols) {
+        t->x = t->cols - 1;
+        t->wrapnext = 1;
+    } else {
+        t->x += w;
+    }
+}
+
+// carries out the CSI sequence in seq
+void btControl(struct benchTerm *t) {
+    int p[8] = {0}, np = 0, i = 2, priv = 0;
+    char final = t->seq[t->nseq - 1];
+    if (t->seq[i] == '?') {
+        priv = 1;
+        i++;
+    }
+    for (; i < t->nseq - 1 && np < 8; i++) {
+        if (t->seq[i] == ';') np++;
+        else if (isdigit((unsigned char) t->seq[i])) p[np] = p[np] * 10 + t->seq[i] - '0';
+        else t->unknown++;
+    }
+    np++;
+    int n = p[0] ? p[0] : 1;
+    if (priv) {
+        if ((final != 'h' && final != 'l') || (p[0] != 25 && p[0] != 2026)) t->unknown++;
+        return;
+    }
+    t->wrapnext = 0;
+    switch (final) {
+        case 'H':
+            t->y = p[0] ? p[0] - 1 : 0;
+            t->x = p[1] ? p[1] - 1 : 0;
+            if (t->y >= t->rows || t->x >= t->cols) t->unknown++;
+            break;
+        case 'A': t->y = t->y - n < 0 ? 0 : t->y - n; break;
+        case 'B': t->y = t->y + n >= t->rows ? t->rows - 1 : t->y + n; break;
+        case 'C': t->x = t->x + n >= t->cols ? t->cols - 1 : t->x + n; break;
+        case 'D': t->x = t->x - n < 0 ? 0 : t->x - n; break;
+        case 'K':
+            if (p[0] != 0) t->unknown++;
+            btErase(t, t->y * t->cols + t->x, t->cols - t->x);
+            break;
+        case 'X': btErase(t, t->y * t->cols + t->x, t->x + n > t->cols ? t->cols - t->x : n); break;
+        case 'J':
+            if (p[0] != 2) t->unknown++;
+            btErase(t, 0, t->rows * t->cols);
+            break;
+        case 'b':
+            for (i = 0; i < n; i++) btPut(t, t->last, utf8Width(t->last));
+            break;
+        case 'r':
+            t->top = p[0] ? p[0] - 1 : 0;
+            t->bot = p[1] ? p[1] - 1 : t->rows - 1;
+            t->y = t->x = 0;
+            break;
+        case 'm':
+            for (i = 0; i < np; i++) {
+                if (p[i] == 0) t->cur = 0;
+                else if (p[i] == 7) t->cur |= ATTR_INVERSE;
+                else if (p[i] == 27) t->cur &= ~ATTR_INVERSE;
+                else if (p[i] >= 30 && p[i] <= 37) t->cur = (t->cur & ~ATTR_FG_MASK) | ATTR_FG(p[i] - 30);
+                else if (p[i] == 39) t->cur &= ~ATTR_FG_MASK;
+                else t->unknown++;
+            }
+            break;
+        default:
+            t->unknown++;
+    }
+}
+
+void btFeed(struct benchTerm *t, const char *s, size_t len) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+        char c = s[i];
+        if (t->nseq > 0) {
+            t->seq[t->nseq++] = c;
+            if (t->nseq == 2 && c != '[') {
+                // the only other escape is a reverse index
+                if (c != 'M') t->unknown++;
+                else if (t->y == t->top) btScroll(t, 0);
+                else if (t->y > 0) t->y--;
+                t->wrapnext = 0;
+                t->nseq = 0;
+            } else if (t->nseq > 2 && c >= 0x40 && c <= 0x7e) {
+                btControl(t);
+                t->nseq = 0;
+            } else if (t->nseq == (int) sizeof(t->seq)) {
+                t->unknown++;
+                t->nseq = 0;
+            }
+            continue;
+        }
+        if (t->nutf8 > 0 || (unsigned char) c >= 0x80) {
+            // the bytes of a character past ASCII, which goes at the cursor once they have all come in
+            t->utf8[t->nutf8++] = c;
+            int len = utf8Len(t->utf8[0]);
+            if (t->nutf8 > 1 && ((unsigned char) c & 0xc0) != 0x80) {
+                t->unknown++;
+                t->nutf8 = 0;
+                continue;
+            }
+            if (t->nutf8 < len) continue;
+            t->nutf8 = 0;
+            unsigned cp;
+            if (utf8Decode(t->utf8, len, &cp) != len || utf8Width(cp) < 1) t->unknown++;
+            else btPut(t, cp, utf8Width(cp));
+        } else if (c == '\x1b') {
+            t->seq[t->nseq++] = c;
+        } else if (c == '\r') {
+            t->x = t->wrapnext = 0;
+        } else if (c == '\n') {
+            btLineFeed(t);
+            t->wrapnext = 0;
+        } else if (c == '\b') {
+            if (t->x > 0) t->x--;
+            t->wrapnext = 0;
+        } else if (c >= 0x20 && c < 0x7f) {
+            btPut(t, c, 1);
+        } else {
+            t->unknown++;
+        }
+    }
+}
+
+// hands the terminal up to max more bytes of the frame, the way frameSend() would write them
+void btTake(struct benchTerm *t, struct frame *f, size_t max) {
+    while (f->first < f->n && max > 0) {
+        struct iovec *iov = &f->iov[f->first];
+        size_t n = iov->iov_len < max ? iov->iov_len : max;
+        btFeed(t, iov->iov_base, n);
+        f->sent += n;
+        max -= n;
+        iov->iov_base = (char *) iov->iov_base + n;
+        iov->iov_len -= n;
+        if (iov->iov_len == 0) f->first++;
+    }
+}
+
+// whether the terminal shows something other than the screen grid cell, seq and attr. blanks only have to agree on the flags, which is
+// all an erase keeps.
+int btDiffers(struct benchTerm *t, const char *cell, const char *seq, const unsigned char *attr) {
+    int i;
+    for (i = 0; i < t->rows * t->cols; i++) {
+        unsigned c = (unsigned char) cell[i];
+        if (cell[i] == CELL_CONT) c = BT_RIGHT;
+        else if (c >= 0x80) utf8Decode(&seq[i * SCREEN_SEQ], SCREEN_SEQ, &c);
+        if (t->cell[i] != c) return 1;
+        if (cell[i] == ' ' ? ((t->attr[i] ^ attr[i]) & ATTR_FLAGS) != 0 : t->attr[i] != attr[i]) return 1;
+    }
+    return 0;
+}
+
+// draws frames of random edits, cursor moves, jumps, messages and resizes the way the render thread does, some of them cut short part
+// way through, and plays each to a model terminal. after every frame the terminal has to show just what the editor thinks it does, and
+// after every frame that went out whole, what a full repaint would have drawn, with the cursor where it belongs. this covers the damage
+// tracking, scrolling, colors, cursor moves, repeats and erases, and cutting frames short.
+int benchFrames() {
+    static const char *inserts[] = {"x", "\n", "        ", "aaaaaaaaaa", "if (n == 42) return \"forty-two\";", "\t", "0000000 1",
+                                    "  -- -- --  ", "// a comment", "h\xc3\xa9llo w\xc3\xb6rld",
+                                    "\xe6\xbc\xa2\xe5\xad\x97\xe3\x81\xa8\xe4\xbb\xae\xe5\x90\x8d", "e\xcc\x81", "\xff", "\xe6\xbc"};
+    int frames = 20000, rows = 24, cols = 80, i, bad = 0, cut = 0;
+    size_t bytes = 0;
+    static struct snapshot snap;
+    static struct benchTerm t;
+
+    benchEditor(rows, cols, (size_t) 1 << 20);
+    E.syntax = 1;
+    E.termscroll = E.termerase = E.termrepeat = 1;
+    btInit(&t, rows, cols, ' ');
+    unsigned seed = 1;
+    for (i = 0; i < frames; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = seed >> 8, n = (r >> 8) % 40, k;
+        switch (r % 11) {
+            case 0: case 1: case 2:
+                for (k = 0; k < n % 4 + 1; k++) editorMoveCursor(ARROW_LEFT + (r >> 16) % 4);
+                break;
+            case 3: case 4: {
+                const char *s = inserts[(r >> 16) % (sizeof(inserts) / sizeof(inserts[0]))];
+                editorInsertText(editorCursorOffset(), s, strlen(s));
+                break;
+            }
+            case 5:
+                if (editorCursorOffset() < E.pt.len) {
+                    size_t len = E.pt.len - editorCursorOffset();
+                    editorDeleteText(editorCursorOffset(), len < n % 8 + 1 ? len : n % 8 + 1);
+                }
+                break;
+            case 6:
+                // a jump of up to a screen and a half, which sometimes the terminal scrolls for and sometimes not
+                for (k = 0; k < n; k++) editorMoveCursor(r & 0x10000 ? ARROW_UP : ARROW_DOWN);
+                break;
+            case 7:
+                editorSetStatusMessage("frame %d", i);
+                break;
+            case 8:
+                // far along a line, so the view moves sideways
+                E.cx = editorLineLen(E.cy) > n * 4 ? n * 4 : editorLineLen(E.cy);
+                break;
+            case 9:
+                E.termsync = !E.termsync;
+                break;
+            case 10:
+                if (n % 8 != 0) break;
+                // a window dragged about, or back to the size it was. either way the terminal may show anything now.
+                if (n % 16 == 0) {
+                    rows = 10 + (r >> 16) % 30;
+                    cols = 20 + (r >> 20) % 100;
+                }
+                editorSetSize(rows, cols);
+                E.resizes++;
+                btInit(&t, rows, cols, '#');
+                break;
+        }
+        editorComposeFrame(&snap);
+        struct frame *f = &E.frame;
+        struct screen *s = &E.screen;
+        bytes += f->len;
+        int cutshort = (seed >> 4) % 4 == 0;
+        if (cutshort && f->len > 0) {
+            // the terminal takes part of the frame before a newer one comes along
+            btTake(&t, f, (seed >> 6) % f->len);
+            screenCut(s, f);
+            cut++;
+        }
+        btTake(&t, f, (size_t) -1);
+
+        const char *what = NULL;
+        if (t.unknown) what = "sent something the screen code doesn't use";
+        else if (btDiffers(&t, s->shown, s->shownseq, s->shownattr)) what = "differs from what the editor thinks it shows";
+        else if (!cutshort && btDiffers(&t, s->next, s->nextseq, s->nextattr)) what = "differs from a full repaint";
+        else if (t.cur != s->attr || t.top != 0 || t.bot != rows - 1) what = "was left with the wrong attributes or scroll region";
+        else if (!cutshort && (t.y != snap.cy || t.x != snap.cx)) what = "has the cursor in the wrong place";
+        if (what != NULL) {
+            if (bad == 0) printf("frame %d: the terminal %s\n", i, what);
+            bad++;
+            // start over from a full repaint, so one mistake isn't counted again in every frame after it
+            t.unknown = 0;
+            s->valid = 0;
+        }
+    }
+    printf("%d frames (%d cut short), %zu bytes/frame, %d wrong\n", frames, cut, bytes / frames, bad);
+    return bad != 0;
+}
+
+// starts the editor on terminals of 1 to 3 rows, and on one of 24 rows that is then shrunk to 2, and draws frames on each with and
+// without soft wrap. the model terminal has the real number of rows, so a frame that reaches past the bottom scrolls it and shows up as a
+// difference. the top row has to hold text, with the status and message bars left out when there is no room for them. build with
+// -fsanitize=address to catch drawing outside the grids.
+int benchSmall() {
+    static const int starts[] = {1, 2, 3, 24}, ends[] = {1, 2, 3, 2};
+    static struct snapshot snap;
+    static struct benchTerm t;
+    int k, i, x, bad = 0;
+    for (k = 0; k < 4; k++) {
+        int rows = starts[k];
+        benchEditor(rows, 40, (size_t) 1 << 16);
+        if (E.wrap) editorToggleWrap();
+        btInit(&t, rows, E.screencols, ' ');
+        for (i = 0; i < 40; i++) {
+            if (i == 20) editorToggleWrap();
+            if (i == 10 && ends[k] != rows) {
+                rows = ends[k];
+                editorSetSize(rows, E.screencols);
+                E.resizes++;
+                btInit(&t, rows, E.screencols, '#');
+            }
+            editorMoveCursor(i % 3 == 0 ? ARROW_DOWN : ARROW_RIGHT);
+            if (i % 5 == 0) editorInsertText(editorCursorOffset(), "x", 1);
+            editorComposeFrame(&snap);
+            btTake(&t, &E.frame, (size_t) -1);
+
+            const char *what = NULL;
+            if (E.screenrows + E.screenbars != rows || E.screen.rows != rows) what = "has a screen of the wrong size";
+            else if (t.unknown || btDiffers(&t, E.screen.shown, E.screen.shownseq, E.screen.shownattr)) what = "differs from the screen";
+            else if (t.y != snap.cy || t.x != snap.cx) what = "has the cursor in the wrong place";
+            for (x = 0; what == NULL && x < snap.len[0]; x++) {
+                if (t.cell[x] != (unsigned char) snap.text[x]) what = "doesn't have text in its top row";
+            }
+            if (what != NULL) {
+                if (bad == 0) printf("%d rows, frame %d: the terminal %s\n", rows, i, what);
+                bad++;
+                t.unknown = 0;
+                E.screen.valid = 0;
+            }
+        }
+    }
+    printf("4 terminal sizes, %d wrong\n", bad);
+    return bad != 0;
+}
+
+int editorBench(const char *name) {
+    if (strcmp(name, "scan") == 0) return benchScan();
+    if (strcmp(name, "index") == 0) return benchIndex();
+    if (strcmp(name, "parallel") == 0) return benchParallel();
+    if (strcmp(name, "draw") == 0) return benchDraw();
+    if (strcmp(name, "wrap") == 0) return benchWrap();
+    if (strcmp(name, "longline") == 0) return benchLongLine();
+    if (strcmp(name, "frames") == 0) return benchFrames();
+    if (strcmp(name, "small") == 0) return benchSmall();
+    fprintf(stderr, "unknown benchmark: %s\n", name);
+    return 1;
+}
+
+#endif
+
+/*** init ***/
+
+void initEditor() {
+    E.cx = 0;
+    E.cy = 0;
+    E.rx = 0;
+    E.rowoff = 0;
+    E.coloff = 0;
+    E.filename = NULL;
+    E.statusmsg[0] = '\0';
+    E.statusmsg_time = 0;
+    E.anchored = 0;
+    E.streamfd = -1;
+    nlInit();
+    memset(&E.pt, 0, sizeof(E.pt));
+    ptInit(&E.pt, NULL, 0, 0);
+    E.pt.addfd = -1;
+    E.pt.spill = E.budget / 2;
+    E.pt.spilldir = E.spilldir;
+    ptTouchReset(&E.pt);
+
+    memset(&E.idx, 0, sizeof(E.idx));
+    pthread_mutex_init(&E.idx.lock, NULL);
+    if (pipe(E.idx.pipe) == -1) die("pipe");
+    fcntl(E.idx.pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(E.idx.pipe[1], F_SETFL, O_NONBLOCK);
+
+    E.winchfirst = E.winchlast = 0;
+    if (pipe(E.winchpipe) == -1) die("pipe");
+    fcntl(E.winchpipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(E.winchpipe[1], F_SETFL, O_NONBLOCK);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = editorHandleWinch;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGWINCH, &sa, NULL) == -1) die("sigaction");
+    // from here on the editor holds the index lock except while it waits for input
+    pthread_mutex_lock(&E.idx.lock);
+
+    // job is to initiaize the rows and cols attributes in the E struct. This is the easy way. 
+    int rows, cols;
+    if (getWindowSize(&rows, &cols) == -1) die("getWindowSize");
+    editorSetSize(rows, cols);
+    screenInit(&E.screen, E.screenrows + E.screenbars, E.screencols);
+    editorQueryTerminal();
+    editorRenderStart();
+}
+
+int main(int argc, char *argv[]) {
+    // characters past ASCII are taken as UTF-8 and measured with wcwidth(), which only knows them in a UTF-8 locale. the one the
+    // environment asks for is used when it is one, and C.UTF-8 otherwise.
+    if (setlocale(LC_CTYPE, "") == NULL || strcmp(nl_langinfo(CODESET), "UTF-8") != 0) setlocale(LC_CTYPE, "C.UTF-8");
+#ifdef ED_BENCH
+    if (argc >= 3 && strcmp(argv[1], "--bench") == 0) return editorBench(argv[2]);
+#endif
+    int opt;
+    E.budget = 0;
+    E.readonly = 0;
+    E.spilldir = NULL;
+    while ((opt = getopt(argc, argv, "d:m:Rw")) != -1) {
+        switch (opt) {
+            case 'R':
+                E.readonly = 1;
+                break;
+            case 'w':
+                E.wrap = 1;
+                break;
+            case 'm':
+                // -m caps resident memory, e.g. -m 8G
+                E.budget = editorParseSize(optarg);
+                if (E.budget == 0) {
+                    fprintf(stderr, "ed: bad memory budget: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                E.spilldir = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: ed [-R] [-w] [-m budget] [-d dir] [file | -]\n"
+                                "  -m caps resident memory, e.g. -m 8G. edits past half of it spill to a scratch file in the directory\n"
+                                "     given with -d, or else next to the file, or in /var/tmp when reading stdin\n");
+                return 1;
+        }
+    }
+
+    // this is checked before the terminal is touched, so refusing leaves it as it was
+    if (optind < argc && editorIsTerminal(argv[optind])) {
+        fprintf(stderr, "ed: won't read a document from the terminal: %s\n", argv[optind]);
+        return 1;
+    }
+
+    editorOpenTerminal();
+    enableRawMode();
+    initEditor();
+    if (optind < argc) {
+        editorOpen(argv[optind]);
+    }
+
+    editorSetStatusMessage("HELP: Ctrl-Q = quit | Ctrl-G = go to line | Ctrl-W = wrap");
+
+    while (1) {
+        editorRefreshScreen();
+        // while the wrap layout has work left, that gets done whenever no key is waiting, a few milliseconds at a time
+        int pending = editorRelayoutPending();
+        if (editorPollEvents(pending ? 0 : editorResizeWait())) {
+            // a paste or a held-down key arrives as a burst, and drawing after every byte of it would only show frames nobody gets to see.
+            // whatever input is already waiting is handled first, and the screen drawn once. a very long paste still gets a frame every
+            // tenth of a second, so it visibly makes progress.
+            double start = editorNow();
+            do {
+                editorProcessKeypress();
+            } while (editorNow() - start < 0.1 && editorKeyWaiting());
+        } else if (pending) {
+            editorRelayout();
+        }
     }
     return 0;
 }
\ No newline at end of file